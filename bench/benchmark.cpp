@@ -0,0 +1,281 @@
+#include "recorder.hpp"
+
+#include <Geode/loader/Mod.hpp>
+#include <Geode/loader/Log.hpp>
+#include <Geode/utils/file.hpp>
+#include <matjson.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+using namespace geode::prelude;
+
+// Headless recorder benchmark, built with -DFFMPEG_API_BENCHMARK=ON and started with
+// --geode:eclipse.ffmpeg-api.benchmark. Results are written to benchmark.json in the save directory.
+//
+// Optional launch arguments:
+//   --geode:eclipse.ffmpeg-api.benchmark-frames=<count>    frames per scenario, defaults to 300
+//   --geode:eclipse.ffmpeg-api.benchmark-codecs=<a,b,...>  codecs to test, defaults to all available
+
+namespace ffmpeg::bench {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Pattern {
+    Gradient,
+    Noise,
+    Static,
+    Scrolling,
+};
+
+struct Scenario {
+    std::string m_codec;
+    PixelFormat m_pixelFormat;
+    const char* m_pixelFormatName;
+    uint32_t m_width;
+    uint32_t m_height;
+    Pattern m_pattern;
+    bool m_doVerticalFlip;
+    std::string m_colorspaceFilters;
+};
+
+struct StageSamples {
+    std::vector<int64_t> m_fill;
+    std::vector<int64_t> m_convert;
+    std::vector<int64_t> m_filter;
+    std::vector<int64_t> m_send;
+    std::vector<int64_t> m_receive;
+    std::vector<int64_t> m_mux;
+};
+
+static const char* getPatternName(Pattern pattern) {
+    switch (pattern) {
+        case Pattern::Gradient: return "gradient";
+        case Pattern::Noise: return "noise";
+        case Pattern::Static: return "static";
+        case Pattern::Scrolling: return "scrolling";
+    }
+    return "unknown";
+}
+
+// writes the frame byte by byte so every packed input format is handled the same way
+static void fillFrame(std::span<uint8_t> data, const Scenario& scenario, uint32_t frame, uint64_t& seed) {
+    size_t rowSize = data.size() / scenario.m_height;
+    size_t bytesPerPixel = rowSize / scenario.m_width;
+
+    if (scenario.m_pattern == Pattern::Noise) {
+        size_t i = 0;
+        for (; i + 8 <= data.size(); i += 8) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            std::memcpy(data.data() + i, &seed, 8);
+        }
+        std::memset(data.data() + i, 0x80, data.size() - i);
+        return;
+    }
+
+    uint32_t shift = 0;
+    if (scenario.m_pattern == Pattern::Gradient)
+        shift = frame;
+    else if (scenario.m_pattern == Pattern::Scrolling)
+        shift = frame * 8;
+
+    for (uint32_t y = 0; y < scenario.m_height; y++) {
+        uint8_t* row = data.data() + y * rowSize;
+        for (uint32_t x = 0; x < scenario.m_width; x++) {
+            uint32_t px = x + shift;
+            for (size_t c = 0; c < bytesPerPixel; c++) {
+                uint32_t value = scenario.m_pattern == Pattern::Scrolling
+                    ? ((px / 32 + y / 32) & 1) * 160 + (px + c * 40) % 96
+                    : (px * 255 / scenario.m_width + y * 255 / scenario.m_height / 2 + c * 85 + shift) & 0xFF;
+                row[x * bytesPerPixel + c] = static_cast<uint8_t>(value);
+            }
+        }
+    }
+}
+
+static matjson::Value getPercentiles(std::vector<int64_t>& samples) {
+    matjson::Value stage;
+    if (samples.empty()) {
+        stage["p50_us"] = 0.0;
+        stage["p99_us"] = 0.0;
+        return stage;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double p) {
+        size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * (samples.size() - 1) + 0.5));
+        return samples[index] / 1000.0;
+    };
+
+    stage["p50_us"] = at(0.50);
+    stage["p99_us"] = at(0.99);
+    return stage;
+}
+
+static matjson::Value runScenario(const Scenario& scenario, uint32_t frameCount, const std::filesystem::path& outputFile) {
+    matjson::Value result;
+    result["codec"] = scenario.m_codec;
+    result["pixel_format"] = std::string(scenario.m_pixelFormatName);
+    result["width"] = scenario.m_width;
+    result["height"] = scenario.m_height;
+    result["pattern"] = std::string(getPatternName(scenario.m_pattern));
+    result["vertical_flip"] = scenario.m_doVerticalFlip;
+    result["colorspace_filters"] = scenario.m_colorspaceFilters;
+
+    StageSamples samples;
+    auto reserve = [&](std::vector<int64_t>& vec) { vec.reserve(frameCount); };
+    reserve(samples.m_fill); reserve(samples.m_convert); reserve(samples.m_filter);
+    reserve(samples.m_send); reserve(samples.m_receive); reserve(samples.m_mux);
+
+    RenderSettings settings;
+    settings.m_codec = scenario.m_codec;
+    settings.m_pixelFormat = scenario.m_pixelFormat;
+    settings.m_width = scenario.m_width;
+    settings.m_height = scenario.m_height;
+    settings.m_doVerticalFlip = scenario.m_doVerticalFlip;
+    settings.m_colorspaceFilters = scenario.m_colorspaceFilters;
+    settings.m_outputFile = outputFile;
+    settings.m_timingCallback = [&samples](const FrameTimings& timings) {
+        samples.m_convert.push_back(timings.m_convert.count());
+        samples.m_filter.push_back(timings.m_filter.count());
+        samples.m_send.push_back(timings.m_send.count());
+        samples.m_receive.push_back(timings.m_receive.count());
+        samples.m_mux.push_back(timings.m_mux.count());
+    };
+
+    Recorder recorder;
+    auto error = [&](std::string message) {
+        recorder.stop();
+        result["error"] = message;
+        return result;
+    };
+
+    if (auto res = recorder.init(settings); res.isErr())
+        return error(res.unwrapErr());
+
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    auto start = Clock::now();
+
+    for (uint32_t i = 0; i < frameCount; i++) {
+        auto acquired = recorder.acquireFrame();
+        if (acquired.isErr())
+            return error(acquired.unwrapErr());
+
+        FrameHandle handle = acquired.unwrap();
+
+        auto fillStart = Clock::now();
+        fillFrame(handle.m_data, scenario, scenario.m_pattern == Pattern::Static ? 0 : i, seed);
+        samples.m_fill.push_back((Clock::now() - fillStart).count());
+
+        if (auto res = recorder.submitFrame(handle); res.isErr())
+            return error(res.unwrapErr());
+    }
+
+    recorder.stop();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    result["frames"] = frameCount;
+    result["fps"] = seconds > 0 ? frameCount / seconds : 0.0;
+
+    matjson::Value stages;
+    stages["fill"] = getPercentiles(samples.m_fill);
+    stages["convert"] = getPercentiles(samples.m_convert);
+    stages["filter"] = getPercentiles(samples.m_filter);
+    stages["send"] = getPercentiles(samples.m_send);
+    stages["receive"] = getPercentiles(samples.m_receive);
+    stages["mux"] = getPercentiles(samples.m_mux);
+    result["stages"] = stages;
+
+    return result;
+}
+
+static std::vector<std::string> getCodecs() {
+    std::vector<std::string> available = Recorder::getAvailableCodecs();
+
+    auto filter = Mod::get()->getLaunchArgument("benchmark-codecs");
+    if (!filter)
+        return available;
+
+    std::vector<std::string> codecs;
+    for (auto& codec : geode::utils::string::split(*filter, ",")) {
+        if (std::ranges::find(available, codec) != available.end())
+            codecs.push_back(codec);
+        else
+            log::warn("Benchmark: codec {} is not available", codec);
+    }
+    return codecs;
+}
+
+static void runBenchmark() {
+    uint32_t frameCount = 300;
+    if (auto frames = Mod::get()->getLaunchArgument("benchmark-frames"))
+        frameCount = std::max(geode::utils::numFromString<uint32_t>(*frames).unwrapOr(frameCount), 1u);
+
+    struct Format {
+        PixelFormat m_format;
+        const char* m_name;
+    };
+    const Format formats[] = {
+        { PixelFormat::RGB0, "rgb0" },
+        { PixelFormat::RGBA, "rgba" },
+        { PixelFormat::BGRA, "bgra" },
+        { PixelFormat::RGB24, "rgb24" },
+    };
+    const std::pair<uint32_t, uint32_t> resolutions[] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 } };
+    const Pattern patterns[] = { Pattern::Gradient, Pattern::Noise, Pattern::Static, Pattern::Scrolling };
+    const char* colorspaceFilters = "all=bt709:iall=bt601-6-625:fast=1";
+
+    // every input format, resolution and pattern, then flip and colorspace variants of the 1080p gradient
+    std::vector<Scenario> scenarios;
+    for (const std::string& codec : getCodecs()) {
+        for (const Format& format : formats) {
+            for (auto [width, height] : resolutions) {
+                for (Pattern pattern : patterns)
+                    scenarios.push_back({ codec, format.m_format, format.m_name, width, height, pattern, true, "" });
+            }
+        }
+
+        scenarios.push_back({ codec, PixelFormat::RGB0, "rgb0", 1920, 1080, Pattern::Gradient, false, "" });
+        scenarios.push_back({ codec, PixelFormat::RGB0, "rgb0", 1920, 1080, Pattern::Gradient, true, colorspaceFilters });
+        scenarios.push_back({ codec, PixelFormat::RGB0, "rgb0", 1920, 1080, Pattern::Gradient, false, colorspaceFilters });
+    }
+
+    std::filesystem::path outputFile = Mod::get()->getSaveDir() / "benchmark.mkv";
+
+    matjson::Value results = matjson::Value::array();
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        const Scenario& scenario = scenarios[i];
+        log::info("Benchmark {}/{}: {} {} {}x{} {}", i + 1, scenarios.size(), scenario.m_codec,
+            scenario.m_pixelFormatName, scenario.m_width, scenario.m_height, getPatternName(scenario.m_pattern));
+
+        results.push(runScenario(scenario, frameCount, outputFile));
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(outputFile, ec);
+
+    matjson::Value report;
+    report["mod_version"] = Mod::get()->getVersion().toVString();
+    report["hardware_threads"] = std::thread::hardware_concurrency();
+    report["frames_per_scenario"] = frameCount;
+    report["results"] = results;
+
+    std::filesystem::path reportFile = Mod::get()->getSaveDir() / "benchmark.json";
+    if (auto res = geode::utils::file::writeString(reportFile, report.dump()); res.isErr())
+        log::error("Could not write benchmark results: {}", res.unwrapErr());
+    else
+        log::info("Benchmark results written to {}", reportFile.string());
+}
+
+}
+
+$execute {
+    if (!Mod::get()->getLaunchFlag("benchmark"))
+        return;
+
+    std::thread(&ffmpeg::bench::runBenchmark).detach();
+}
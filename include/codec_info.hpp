@@ -0,0 +1,31 @@
+#pragma once
+
+#include "export.hpp"
+#include "render_settings.hpp"
+
+#include <string>
+#include <vector>
+
+BEGIN_FFMPEG_NAMESPACE_V
+
+/**
+ * @brief What a video encoder supports on this machine, see Recorder::getCodecInfo.
+ */
+struct CodecInfo {
+    std::string m_name;
+    std::string m_longName;
+    // in order of preference, the first one is what the encoder picks by default
+    std::vector<PixelFormat> m_pixelFormats;
+    // the encoder runs on a GPU or other dedicated hardware
+    bool m_hardware = false;
+    bool m_frameThreads = false;
+    bool m_sliceThreads = false;
+    // the codec library manages its own threads
+    bool m_codecThreads = false;
+    // the encoder can be flushed and reused, see Recorder::restart
+    bool m_flushable = false;
+    // a small test encoder could be opened, false for e.g. nvenc without a driver
+    bool m_working = false;
+};
+
+END_FFMPEG_NAMESPACE_V
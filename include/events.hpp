@@ -1,12 +1,15 @@
 #pragma once
 
 #include "render_settings.hpp"
+#include "frame_handle.hpp"
+#include "recorder_stats.hpp"
+#include "codec_info.hpp"
 
 #include <Geode/loader/Event.hpp>
 
 namespace ffmpeg::events {
 namespace impl {
-    constexpr size_t VTABLE_VERSION = 1;
+    constexpr size_t VTABLE_VERSION = 2;
     using CreateRecorder_t = void*(*)();
     using DeleteRecorder_t = void(*)(void*);
     using InitRecorder_t = geode::Result<>(*)(void*, const RenderSettings&);
@@ -15,6 +18,20 @@ namespace impl {
     using GetAvailableCodecs_t = std::vector<std::string>(*)();
     using MixVideoAudio_t = geode::Result<>(*)(const std::filesystem::path&, const std::filesystem::path&, const std::filesystem::path&);
     using MixVideoRaw_t = geode::Result<>(*)(const std::filesystem::path&, std::span<float>, const std::filesystem::path&);
+    using GetRecorderStatus_t = geode::Result<>(*)(void*);
+    using WriteFrameOwned_t = geode::Result<>(*)(void*, std::vector<uint8_t>&&);
+    using AcquireFrame_t = geode::Result<FrameHandle>(*)(void*);
+    using SubmitFrame_t = geode::Result<>(*)(void*, FrameHandle&);
+    using ReleaseFrame_t = void(*)(void*, FrameHandle&);
+    using WriteFrames_t = geode::Result<>(*)(void*, std::span<std::span<uint8_t const> const>);
+    using GetRecorderStats_t = void(*)(void*, RecorderStats*, size_t);
+    using WriteFrameTimed_t = geode::Result<>(*)(void*, std::span<uint8_t const>, int64_t);
+    using SaveReplay_t = geode::Result<>(*)(void*, const std::filesystem::path&);
+    using WriteAudio_t = geode::Result<>(*)(void*, std::span<float const>, int64_t);
+    using RestartRecorder_t = geode::Result<>(*)(void*, const std::filesystem::path&);
+    using GetCodecInfo_t = std::vector<CodecInfo>(*)();
+    using InitRecorderSized_t = geode::Result<>(*)(void*, const RenderSettings&, size_t);
+    using SelectCodec_t = geode::Result<std::string>(*)(const RenderSettings&, size_t);
 
     struct VTable {
         CreateRecorder_t createRecorder = nullptr;
@@ -25,6 +42,22 @@ namespace impl {
         GetAvailableCodecs_t getAvailableCodecs = nullptr;
         MixVideoAudio_t mixVideoAudio = nullptr;
         MixVideoRaw_t mixVideoRaw = nullptr;
+
+        // version 2, RenderSettings is passed with its size from here on
+        InitRecorderSized_t initRecorderSized = nullptr;
+        GetRecorderStatus_t getRecorderStatus = nullptr;
+        WriteFrameOwned_t writeFrameOwned = nullptr;
+        AcquireFrame_t acquireFrame = nullptr;
+        SubmitFrame_t submitFrame = nullptr;
+        ReleaseFrame_t releaseFrame = nullptr;
+        WriteFrames_t writeFrames = nullptr;
+        GetRecorderStats_t getRecorderStats = nullptr;
+        WriteFrameTimed_t writeFrameTimed = nullptr;
+        SaveReplay_t saveReplay = nullptr;
+        WriteAudio_t writeAudio = nullptr;
+        RestartRecorder_t restartRecorder = nullptr;
+        GetCodecInfo_t getCodecInfo = nullptr;
+        SelectCodec_t selectCodec = nullptr;
     };
 
     struct FetchVTableEvent : geode::Event<FetchVTableEvent, bool(VTable&, size_t)> {
@@ -76,6 +109,9 @@ public:
      */
     geode::Result<> init(RenderSettings const& settings) {
         auto& vtable = impl::getVTable();
+        if (vtable.initRecorderSized) {
+            return vtable.initRecorderSized(m_ptr, settings, sizeof(settings));
+        }
         if (!vtable.initRecorder) {
             return geode::Err("FFmpeg API is not available.");
         }
@@ -94,6 +130,27 @@ public:
         }
     }
 
+    /**
+     * @brief Finishes the current file and continues recording into a new one.
+     *
+     * Much faster than stop and init: the encoder is flushed and reused if it
+     * supports that (otherwise only reopened with the same settings), and the
+     * conversion state, filter graph and frame pools are kept. Frame and audio
+     * timestamps start over at zero for the new file.
+     *
+     * @param path The new output file. Segmented recordings start a new series of segments.
+     *
+     * @return true if the new file is successfully opened, false if there is an error.
+     *         After an error the recorder has to be stopped.
+     */
+    geode::Result<> restart(std::filesystem::path const& path) {
+        auto& vtable = impl::getVTable();
+        if (!vtable.restartRecorder) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.restartRecorder(m_ptr, path);
+    }
+
     /**
      * @brief Writes a single video frame to the output.
      *
@@ -115,11 +172,203 @@ public:
         return vtable.writeFrame(m_ptr, frameData);
     }
 
+    /**
+     * @brief Writes a single video frame with its own timestamp.
+     *
+     * Requires RenderSettings::m_variableFrameRate. Frames are only encoded when
+     * they are written, so hitches and static stretches don't have to be filled
+     * with duplicate frames.
+     *
+     * @param frameData A vector containing the raw frame data to be written.
+     * @param timestampMicros The presentation time of the frame in microseconds,
+     *                        must be larger than the previous frame's.
+     *
+     * @return true if the frame is successfully written, false if there is an error.
+     *
+     * @warning Ensure that the frameData size matches the expected dimensions of the frame.
+     */
+    geode::Result<> writeFrame(std::span<uint8_t const> frameData, int64_t timestampMicros) {
+        auto& vtable = impl::getVTable();
+        if (!vtable.writeFrameTimed) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.writeFrameTimed(m_ptr, frameData, timestampMicros);
+    }
+
+    /**
+     * @brief Writes a single video frame to the output, taking ownership of its data.
+     *
+     * Unlike the span overload, the frame data doesn't have to be copied, the buffer
+     * is handed straight to the converter, filter graph and encoder and is released
+     * once they are done with it.
+     *
+     * @param frameData A vector containing the raw frame data to be written.
+     *
+     * @return true if the frame is successfully written, false if there is an error.
+     *
+     * @warning Ensure that the frameData size matches the expected dimensions of the frame.
+     */
+    geode::Result<> writeFrame(std::vector<uint8_t>&& frameData) {
+        auto& vtable = impl::getVTable();
+        if (!vtable.writeFrameOwned) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.writeFrameOwned(m_ptr, std::move(frameData));
+    }
+
+    /**
+     * @brief Writes a batch of video frames to the output.
+     *
+     * The frames are validated once, converted in parallel and then fed to the
+     * encoder in order. This is meant for offline rendering, where it is much
+     * faster than calling writeFrame for every frame.
+     *
+     * @param frames The raw frame data of every frame, in presentation order.
+     *
+     * @return true if all frames are successfully written, false if there is an error.
+     *
+     * @warning Every frame must match the expected dimensions of the frame.
+     */
+    geode::Result<> writeFrames(std::span<std::span<uint8_t const> const> frames) {
+        auto& vtable = impl::getVTable();
+        if (!vtable.writeFrames) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.writeFrames(m_ptr, frames);
+    }
+
+    /**
+     * @brief Acquires a pooled frame buffer owned by the recorder.
+     *
+     * The returned buffer can be filled directly (for example by a GPU readback)
+     * and then passed to submitFrame, which avoids allocating and copying a frame
+     * on every call. Buffers are recycled once the encoder is done with them.
+     *
+     * @return A handle to a writable, 64-byte aligned frame buffer.
+     */
+    geode::Result<FrameHandle> acquireFrame() {
+        auto& vtable = impl::getVTable();
+        if (!vtable.acquireFrame) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.acquireFrame(m_ptr);
+    }
+
+    /**
+     * @brief Queues a frame acquired with acquireFrame for encoding.
+     *
+     * The handle is reset and must not be used afterwards.
+     *
+     * @param handle The handle returned by acquireFrame.
+     *
+     * @return true if the frame is successfully written, false if there is an error.
+     */
+    geode::Result<> submitFrame(FrameHandle& handle) {
+        auto& vtable = impl::getVTable();
+        if (!vtable.submitFrame) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.submitFrame(m_ptr, handle);
+    }
+
+    /**
+     * @brief Gives a frame acquired with acquireFrame back without encoding it.
+     *
+     * @param handle The handle returned by acquireFrame, it is reset.
+     */
+    void releaseFrame(FrameHandle& handle) {
+        auto& vtable = impl::getVTable();
+        if (vtable.releaseFrame) {
+            vtable.releaseFrame(m_ptr, handle);
+        }
+    }
+
+    /**
+     * @brief Writes audio samples to the live audio track.
+     *
+     * Requires RenderSettings::m_audioCodec. The samples are encoded into a second
+     * stream of the same output and interleaved with the video as they arrive, so
+     * no mixing pass is needed after recording. Can be called from an audio thread.
+     *
+     * Gaps in the timestamps are filled with silence and overlapping samples are
+     * dropped, small jitter is ignored so continuous audio stays untouched.
+     *
+     * @param samples Interleaved stereo samples at RenderSettings::m_audioSampleRate.
+     * @param timestampMicros Time of the first sample in microseconds, on the same
+     *                        timeline as the video (frame n of a constant frame rate
+     *                        recording is at n / fps seconds).
+     *
+     * @return true if the samples are successfully written, false if there is an error.
+     */
+    geode::Result<> writeAudio(std::span<float const> samples, int64_t timestampMicros) {
+        auto& vtable = impl::getVTable();
+        if (!vtable.writeAudio) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.writeAudio(m_ptr, samples, timestampMicros);
+    }
+
+    /**
+     * @brief Writes the contents of the replay buffer to a file.
+     *
+     * Requires RenderSettings::m_replayDuration. The buffered packets are muxed
+     * as they are, without re-encoding, while recording continues. The clip
+     * starts at a keyframe, so it can be slightly longer than the configured duration.
+     *
+     * @param path The output file, its extension selects the container.
+     *
+     * @return true if the clip is successfully written, false if there is an error.
+     */
+    geode::Result<> saveReplay(std::filesystem::path const& path) {
+        auto& vtable = impl::getVTable();
+        if (!vtable.saveReplay) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.saveReplay(m_ptr, path);
+    }
+
+    /**
+     * @brief Returns the current state of the asynchronous encoder.
+     *
+     * When RenderSettings::m_asyncEncode is enabled, frames are encoded on a
+     * background thread, so encoding errors can't be returned from the writeFrame
+     * call that submitted the frame. This function reports the first such error.
+     * In synchronous mode it always succeeds.
+     *
+     * @return Ok if no error has occurred, otherwise the first encoding error.
+     */
+    geode::Result<> getStatus() {
+        auto& vtable = impl::getVTable();
+        if (!vtable.getRecorderStatus) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.getRecorderStatus(m_ptr);
+    }
+
+    /**
+     * @brief Returns live statistics of the encoding pipeline.
+     *
+     * The counters are updated without locks, so this is cheap enough to call
+     * every frame, e.g. from an overlay, and never stalls the encoder.
+     *
+     * @return Frame counters, queue depth, output size and bitrate, and latency
+     *         histograms of the most recent frames. Empty if the API is not available.
+     */
+    RecorderStats getStats() {
+        RecorderStats stats;
+        auto& vtable = impl::getVTable();
+        if (vtable.getRecorderStats) {
+            vtable.getRecorderStats(m_ptr, &stats, sizeof(stats));
+        }
+        return stats;
+    }
+
     /**
      * @brief Retrieves a list of available codecs for video encoding.
      *
-     * This function iterates through all available codecs in FFmpeg and 
-     * returns a sorted vector of codec names.
+     * Only encoders that could actually be opened on this machine are listed, in FFmpeg's order.
+     * The list comes from a registry built in the background when the mod loads,
+     * so the first call may wait for it to finish.
      * 
      * @return A vector representing the names of available codecs.
      */
@@ -131,6 +380,39 @@ public:
         return vtable.getAvailableCodecs();
     }
 
+    /**
+     * @brief Retrieves the capabilities of every video encoder in this FFmpeg build.
+     *
+     * Includes encoders that failed to open, see CodecInfo::m_working.
+     * Like getAvailableCodecs, this may wait for the registry to finish building.
+     */
+    static std::vector<CodecInfo> getCodecInfo() {
+        auto& vtable = impl::getVTable();
+        if (!vtable.getCodecInfo) {
+            return {};
+        }
+        return vtable.getCodecInfo();
+    }
+
+    /**
+     * @brief Picks the encoder for the settings' m_codec = AUTO_CODEC.
+     *
+     * Working encoders the output container can hold are benchmarked on a short synthetic clip
+     * at the settings' resolution, frame rate and encoder profile, best compression first.
+     * The first one that encodes 1.5x faster than realtime wins. The choice is cached per machine and
+     * configuration (resolution, frame rate, container, pixel format, bitrate, encoder options and threading),
+     * so only the first call for a configuration takes a moment.
+     *
+     * @return The name of the selected encoder, or an error if none keeps up.
+     */
+    static geode::Result<std::string> selectCodec(const RenderSettings& settings) {
+        auto& vtable = impl::getVTable();
+        if (!vtable.selectCodec) {
+            return geode::Err("FFmpeg API is not available.");
+        }
+        return vtable.selectCodec(settings, sizeof(settings));
+    }
+
 private:
     void* m_ptr = nullptr;
 };
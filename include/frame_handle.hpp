@@ -0,0 +1,24 @@
+#pragma once
+
+#include "export.hpp"
+
+#include <cstdint>
+#include <span>
+
+BEGIN_FFMPEG_NAMESPACE_V
+
+/**
+ * @brief A frame buffer owned by the recorder, handed out by Recorder::acquireFrame.
+ *
+ * The data is 64-byte aligned and sized for exactly one frame in the input pixel format.
+ * A handle must be given back with either Recorder::submitFrame or Recorder::releaseFrame,
+ * both of which reset it.
+ */
+struct FrameHandle {
+    void* m_buffer = nullptr;
+    std::span<uint8_t> m_data;
+
+    bool isValid() const { return m_buffer != nullptr; }
+};
+
+END_FFMPEG_NAMESPACE_V
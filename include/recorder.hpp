@@ -1,6 +1,9 @@
 #pragma once
 
 #include "render_settings.hpp"
+#include "frame_handle.hpp"
+#include "recorder_stats.hpp"
+#include "codec_info.hpp"
 #include "export.hpp"
 
 #include <Geode/Result.hpp>
@@ -8,19 +11,54 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <optional>
+#include <atomic>
 #include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 class AVFormatContext;
+class AVOutputFormat;
 class AVCodec;
 class AVStream;
 class AVCodecContext;
 class AVBufferRef;
+class AVBufferPool;
 class AVFrame;
 class AVPacket;
 class SwsContext;
 class AVFilterContext;
 class AVFilter;
 class AVFilterGraph;
+class AVAudioFifo;
+class SwrContext;
+
+namespace ffmpeg::convert {
+    struct FastConverter;
+}
+
+namespace ffmpeg::hash {
+    struct FrameHasher;
+}
+
+namespace ffmpeg::io {
+    class FileWriter;
+    class CallbackWriter;
+}
+
+namespace ffmpeg::replay {
+    class ReplayBuffer;
+}
+
+namespace ffmpeg::chunk {
+    class ChunkEncoder;
+}
+
+namespace ffmpeg::utils {
+    class WorkerPool;
+}
 
 BEGIN_FFMPEG_NAMESPACE_V
 
@@ -36,22 +74,173 @@ private:
         AVFrame* m_frame = nullptr;
         AVFrame* m_convertedFrame = nullptr;
         AVFrame* m_filteredFrame = nullptr;
+        AVFrame* m_sourceView = nullptr;
+        std::function<void(const FrameTimings&)> m_timingCallback;
+        FrameTimings m_timings;
+        std::vector<SwsContext*> m_batchSwsCtxs;
+        std::vector<AVFrame*> m_batchSourceViews;
+        utils::WorkerPool* m_batchPool = nullptr;
         AVPacket* m_packet = nullptr;
         SwsContext* m_swsCtx = nullptr;
+        convert::FastConverter* m_fastConverter = nullptr;
+        hash::FrameHasher* m_frameHasher = nullptr;
+        io::FileWriter* m_fileWriter = nullptr;
+        io::CallbackWriter* m_callbackWriter = nullptr;
+        replay::ReplayBuffer* m_replayBuffer = nullptr;
+        chunk::ChunkEncoder* m_chunkEncoder = nullptr;
+        std::vector<std::pair<std::string, std::string>> m_codecOptions;
+        uint32_t m_encoderThreads = 0;
+        ThreadType m_encoderThreadType = ThreadType::AUTO;
+
+        // audio is written by the caller's thread, video possibly by the encoding thread
+        const AVCodec* m_audioCodec = nullptr;
+        AVCodecContext* m_audioCodecContext = nullptr;
+        AVStream* m_audioStream = nullptr;
+        SwrContext* m_audioResampler = nullptr;
+        AVAudioFifo* m_audioFifo = nullptr;
+        AVFrame* m_audioFrame = nullptr;
+        AVPacket* m_audioPacket = nullptr;
+        uint8_t* m_audioBuffer[2]{};
+        int m_audioBufferSamples = 0;
+        int m_audioInputRate = 0;
+        int64_t m_audioNextSample = 0;
+        int64_t m_audioPts = 0;
+        // set by restart until the audio encoder is reset, writeAudio drops samples meanwhile. guarded by m_audioMutex
+        bool m_audioRestarting = false;
+        std::mutex m_audioMutex;
+        std::mutex m_muxMutex;
+        int m_hashRowSize = 0;
+        std::optional<uint64_t> m_lastFrameHash;
+        std::optional<int64_t> m_skippedTailPts;
+        AVBufferRef* m_duplicateBuffer = nullptr;
+        uint8_t* m_duplicateData = nullptr;
         AVFilterGraph* m_filterGraph = nullptr;
         AVFilterContext* m_buffersrcCtx = nullptr;
         AVFilterContext* m_buffersinkCtx = nullptr;
-        AVFilterContext* m_colorspaceCtx = nullptr;
-        AVFilterContext* m_vflipCtx = nullptr;
 
-        size_t m_frameCount = 0;
+        // every frame since init, for the stats
+        std::atomic<size_t> m_frameCount = 0;
+        // timestamp of the next constant frame rate frame, starts over on restart
+        int64_t m_nextPts = 0;
         size_t m_expectedSize = 0;
         bool m_init = false;
+        bool m_headerWritten = false;
+        bool m_doVerticalFlip = false;
+        bool m_graphRetainsFrames = false;
+        bool m_variableFrameRate = false;
+        int64_t m_frameDuration = 1;
+        int64_t m_lastPts = 0;
+
+        RenderSettings m_settings;
+        bool m_fragmentedOutput = false;
+        std::filesystem::path m_outputFile;
+        std::filesystem::path m_segmentPath;
+        std::function<void(const std::filesystem::path&)> m_segmentCallback;
+        int64_t m_segmentDuration = 0;
+        uint64_t m_segmentSize = 0;
+        uint32_t m_segmentIndex = 0;
+        int64_t m_segmentStart = 0;
+        int64_t m_segmentOffset = 0;
+        uint64_t m_segmentBytes = 0;
+        // why the next segment couldn't be opened, every later packet fails with it until restart
+        std::string m_segmentError;
+        int64_t m_nextKeyframePts = 0;
+
+        bool m_async = false;
+        bool m_dropFramesWhenFull = false;
+        size_t m_maxQueuedFrames = 0;
+        AVBufferPool* m_inputPool = nullptr;
+        AVBufferPool* m_convertedPool = nullptr;
+        std::thread m_encodeThread;
+        std::mutex m_queueMutex;
+        std::condition_variable m_queueCondition;
+        std::condition_variable m_spaceCondition;
+        std::deque<AVFrame*> m_frameQueue;
+        std::string m_asyncError;
+        bool m_stopRequested = false;
+
+        // single writer (whichever thread encodes), read lock-free by getStats
+        struct LatencyRing {
+            static constexpr size_t SIZE = 256;
+            std::array<std::atomic<uint8_t>, SIZE> m_buckets{};
+            std::atomic<uint64_t> m_count = 0;
+
+            void push(std::chrono::nanoseconds duration);
+            LatencyHistogram getHistogram() const;
+        };
+
+        std::atomic<uint64_t> m_framesEncoded = 0;
+        std::atomic<uint64_t> m_framesDropped = 0;
+        std::atomic<uint64_t> m_framesSkipped = 0;
+        std::atomic<uint32_t> m_queueDepth = 0;
+        std::atomic<uint64_t> m_bytesWritten = 0;
+        // filled in by the file writer, kept here so getStats never touches the writer itself
+        std::atomic<uint64_t> m_pendingWriteBytes = 0;
+        std::atomic<uint64_t> m_writeStalls = 0;
+        std::atomic<double> m_bitrate = 0.0;
+        std::deque<std::pair<double, int>> m_bitrateWindow;
+        int64_t m_bitrateWindowBytes = 0;
+        LatencyRing m_conversionLatency;
+        LatencyRing m_filterLatency;
+        LatencyRing m_encodeLatency;
+        LatencyRing m_muxLatency;
+        LatencyRing m_diskLatency;
+
+        ~Impl();
 
         geode::Result<> init(const RenderSettings& settings);
         void stop();
-        geode::Result<> writeFrame(std::span<uint8_t const> frameData);
+        geode::Result<> writeFrame(std::span<uint8_t const> frameData, std::optional<int64_t> timestampMicros = std::nullopt);
+        geode::Result<> writeFrame(std::vector<uint8_t>&& frameData);
+        geode::Result<FrameHandle> acquireFrame();
+        geode::Result<> submitFrame(FrameHandle& handle);
+        void releaseFrame(FrameHandle& handle);
+        geode::Result<> submitBuffer(AVBufferRef* buffer, uint8_t* data, std::optional<int64_t> timestampMicros = std::nullopt);
+        geode::Result<int64_t> nextTimestamp(std::optional<int64_t> timestampMicros);
+        geode::Result<> setTimestamp(AVFrame* frame, std::optional<int64_t> timestampMicros);
+        geode::Result<bool> skipDuplicate(const uint8_t* data, AVBufferRef*& buffer, std::optional<int64_t> timestampMicros);
+        geode::Result<> encodeSkippedTail();
+        geode::Result<bool> waitForQueueSpace();
+        geode::Result<> writeFrames(std::span<std::span<uint8_t const> const> frames);
+        geode::Result<> encodeFrame(AVFrame* frame);
+        geode::Result<> convertFrame(AVFrame* frame, AVFrame* converted, SwsContext* swsCtx, AVFrame* sourceView);
+        geode::Result<> encodeConverted(AVFrame* frame);
+        bool needsConversion() const;
+        geode::Result<> referenceSource(AVFrame* frame, AVFrame* view, bool wrapBorrowed);
+        SwsContext* createSwsContext(int threads);
+        geode::Result<> sendFrame(AVFrame* frame);
+        geode::Result<> writePacket(AVPacket* packet);
+        geode::Result<AVCodecContext*> cloneEncoder(int threads);
+        void createChunkEncoder();
+        geode::Result<> createFilterGraph(const std::string& filters, int format, uint32_t threads);
+        geode::Result<> openContainer(const AVOutputFormat* format, const std::filesystem::path& path);
+        geode::Result<> openStreams(const std::filesystem::path& path);
+        void finishOutput();
+        void stopEncodeThread();
+        geode::Result<> restart(const std::filesystem::path& path);
+        geode::Result<> resetAudio();
+        int getPooledFrame(AVFrame* frame, AVBufferPool* pool, int format);
         geode::Result<> filterFrame(AVFrame* inputFrame, AVFrame* outputFrame);
+        geode::Result<> getFilteredFrame(AVFrame* outputFrame);
+        geode::Result<> sendFiltered();
+        geode::Result<> getStatus();
+        RecorderStats getStats() const;
+        void recordPacket(AVPacket* packet);
+        geode::Result<> openOutput(const RenderSettings& settings);
+        geode::Result<> openFile(const std::filesystem::path& path);
+        geode::Result<> writeHeader();
+        bool isSegmented() const;
+        geode::Result<> startSegment(int64_t pts);
+        geode::Result<> saveReplay(const std::filesystem::path& path);
+        geode::Result<> initAudio(const RenderSettings& settings);
+        geode::Result<> addAudioStream(AVFormatContext* formatContext);
+        geode::Result<> writeAudio(std::span<float const> samples, int64_t timestampMicros);
+        geode::Result<> queueAudio(const float* samples, int count);
+        geode::Result<> encodeAudio(bool flush);
+        geode::Result<> sendAudioFrame(AVFrame* frame);
+        void freeAudio();
+        void closeOutput();
+        void encodeLoop();
     };
 
     std::unique_ptr<Impl> m_impl = nullptr;
@@ -81,6 +270,23 @@ public:
      */
     void stop() const { m_impl->stop(); }
 
+    /**
+     * @brief Finishes the current file and continues recording into a new one.
+     *
+     * Much faster than stop and init: the encoder is flushed and reused if it
+     * supports that (otherwise only reopened with the same settings), and the
+     * conversion state, filter graph and frame pools are kept. Frame and audio
+     * timestamps start over at zero for the new file, getStats keeps counting.
+     *
+     * @param path The new output file. Segmented recordings start a new series of segments.
+     *
+     * @return true if the new file is successfully opened, false if there is an error.
+     *         After an error the recorder has to be stopped.
+     */
+    geode::Result<> restart(const std::filesystem::path& path) const {
+        return m_impl->restart(path);
+    }
+
     /**
      * @brief Writes a single video frame to the output.
      *
@@ -88,6 +294,9 @@ public:
      * to the output file. The frame data must match the expected format and 
      * dimensions defined during initialization.
      *
+     * In asynchronous mode the frame is copied into a queue and encoded on a
+     * background thread; errors from that thread are returned by the next call.
+     *
      * @param frameData A vector containing the raw frame data to be written.
      * 
      * @return true if the frame is successfully written, false if there is an error.
@@ -98,16 +307,193 @@ public:
         return m_impl->writeFrame(frameData);
     }
 
+    /**
+     * @brief Writes a single video frame with its own timestamp.
+     *
+     * Requires RenderSettings::m_variableFrameRate. Frames are only encoded when
+     * they are written, so hitches and static stretches don't have to be filled
+     * with duplicate frames.
+     *
+     * @param frameData A vector containing the raw frame data to be written.
+     * @param timestampMicros The presentation time of the frame in microseconds,
+     *                        must be larger than the previous frame's.
+     *
+     * @return true if the frame is successfully written, false if there is an error.
+     *
+     * @warning Ensure that the frameData size matches the expected dimensions of the frame.
+     */
+    geode::Result<> writeFrame(std::span<uint8_t const> frameData, int64_t timestampMicros) const {
+        return m_impl->writeFrame(frameData, timestampMicros);
+    }
+
+    /**
+     * @brief Writes a single video frame to the output, taking ownership of its data.
+     *
+     * Unlike the span overload, the frame data doesn't have to be copied, the buffer
+     * is handed straight to the converter, filter graph and encoder and is released
+     * once they are done with it.
+     *
+     * @param frameData A vector containing the raw frame data to be written.
+     *
+     * @return true if the frame is successfully written, false if there is an error.
+     *
+     * @warning Ensure that the frameData size matches the expected dimensions of the frame.
+     */
+    geode::Result<> writeFrame(std::vector<uint8_t>&& frameData) const {
+        return m_impl->writeFrame(std::move(frameData));
+    }
+
+    /**
+     * @brief Writes a batch of video frames to the output.
+     *
+     * The frames are validated once, converted in parallel and then fed to the
+     * encoder in order. This is meant for offline rendering, where it is much
+     * faster than calling writeFrame for every frame.
+     *
+     * @param frames The raw frame data of every frame, in presentation order.
+     *
+     * @return true if all frames are successfully written, false if there is an error.
+     *
+     * @warning Every frame must match the expected dimensions of the frame.
+     */
+    geode::Result<> writeFrames(std::span<std::span<uint8_t const> const> frames) const {
+        return m_impl->writeFrames(frames);
+    }
+
+    /**
+     * @brief Acquires a pooled frame buffer owned by the recorder.
+     *
+     * The returned buffer can be filled directly (for example by a GPU readback)
+     * and then passed to submitFrame, which avoids allocating and copying a frame
+     * on every call. Buffers are recycled once the encoder is done with them.
+     *
+     * @return A handle to a writable, 64-byte aligned frame buffer.
+     */
+    geode::Result<FrameHandle> acquireFrame() const {
+        return m_impl->acquireFrame();
+    }
+
+    /**
+     * @brief Queues a frame acquired with acquireFrame for encoding.
+     *
+     * The handle is reset and must not be used afterwards.
+     *
+     * @param handle The handle returned by acquireFrame.
+     *
+     * @return true if the frame is successfully written, false if there is an error.
+     */
+    geode::Result<> submitFrame(FrameHandle& handle) const {
+        return m_impl->submitFrame(handle);
+    }
+
+    /**
+     * @brief Gives a frame acquired with acquireFrame back without encoding it.
+     *
+     * @param handle The handle returned by acquireFrame, it is reset.
+     */
+    void releaseFrame(FrameHandle& handle) const {
+        m_impl->releaseFrame(handle);
+    }
+
+    /**
+     * @brief Writes audio samples to the live audio track.
+     *
+     * Requires RenderSettings::m_audioCodec. The samples are encoded into a second
+     * stream of the same output and interleaved with the video as they arrive, so
+     * no mixing pass is needed after recording. Can be called from an audio thread.
+     *
+     * Gaps in the timestamps are filled with silence and overlapping samples are
+     * dropped, small jitter is ignored so continuous audio stays untouched.
+     * Samples written while restart is switching files are dropped as well.
+     *
+     * @param samples Interleaved stereo samples at RenderSettings::m_audioSampleRate.
+     * @param timestampMicros Time of the first sample in microseconds, on the same
+     *                        timeline as the video (frame n of a constant frame rate
+     *                        recording is at n / fps seconds).
+     *
+     * @return true if the samples are successfully written, false if there is an error.
+     */
+    geode::Result<> writeAudio(std::span<float const> samples, int64_t timestampMicros) const {
+        return m_impl->writeAudio(samples, timestampMicros);
+    }
+
+    /**
+     * @brief Writes the contents of the replay buffer to a file.
+     *
+     * Requires RenderSettings::m_replayDuration. The buffered packets are muxed
+     * as they are, without re-encoding, while recording continues. The clip
+     * starts at a keyframe, so it can be slightly longer than the configured duration.
+     *
+     * @param path The output file, its extension selects the container.
+     *
+     * @return true if the clip is successfully written, false if there is an error.
+     */
+    geode::Result<> saveReplay(const std::filesystem::path& path) const {
+        return m_impl->saveReplay(path);
+    }
+
+    /**
+     * @brief Returns the current state of the asynchronous encoder.
+     *
+     * When RenderSettings::m_asyncEncode is enabled, frames are encoded on a
+     * background thread, so encoding errors can't be returned from the writeFrame
+     * call that submitted the frame. This function reports the first such error.
+     * In synchronous mode it always succeeds.
+     *
+     * @return Ok if no error has occurred, otherwise the first encoding error.
+     */
+    geode::Result<> getStatus() const {
+        return m_impl->getStatus();
+    }
+
+    /**
+     * @brief Returns live statistics of the encoding pipeline.
+     *
+     * The counters are updated without locks, so this is cheap enough to call
+     * every frame, e.g. from an overlay, and never stalls the encoder.
+     *
+     * @return Frame counters, queue depth, output size and bitrate, and latency
+     *         histograms of the most recent frames.
+     */
+    RecorderStats getStats() const {
+        if (!m_impl)
+            return {};
+        return m_impl->getStats();
+    }
+
     /**
      * @brief Retrieves a list of available codecs for video encoding.
      *
-     * This function iterates through all available codecs in FFmpeg and 
-     * returns a sorted vector of codec names.
+     * Only encoders that could actually be opened on this machine are listed, in FFmpeg's order.
+     * The list comes from a registry built in the background when the mod loads,
+     * so the first call may wait for it to finish.
      * 
      * @return A vector representing the names of available codecs.
      */
     static std::vector<std::string> getAvailableCodecs();
 
+    /**
+     * @brief Retrieves the capabilities of every H.264, HEVC, VP8, VP9, AV1 and MPEG-4 encoder in this FFmpeg build.
+     *
+     * Includes encoders that failed to open, see CodecInfo::m_working.
+     * Like getAvailableCodecs, this may wait for the registry to finish building.
+     */
+    static std::vector<CodecInfo> getCodecInfo();
+
+    /**
+     * @brief Picks the encoder for the settings' m_codec = AUTO_CODEC.
+     *
+     * Working encoders the output container can hold are benchmarked on a short synthetic clip
+     * at the settings' resolution, frame rate and encoder profile, best compression first.
+     * The first one that encodes 1.5x faster than realtime wins. The choice is cached per machine and
+     * configuration (resolution, frame rate, container, pixel format, bitrate, encoder options and threading),
+     * so only the first call for a configuration takes a moment.
+     * init doesn't wait for this, it uses a fallback encoder until the configuration has been benchmarked.
+     *
+     * @return The name of the selected encoder, or an error if none keeps up.
+     */
+    static geode::Result<std::string> selectCodec(const RenderSettings& settings);
+
 private:
     geode::Result<> filterFrame(AVFrame* inputFrame, AVFrame* outputFrame) const {
         return m_impl->filterFrame(inputFrame, outputFrame);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "export.hpp"
+#include "render_settings.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+BEGIN_FFMPEG_NAMESPACE_V
+
+/**
+ * @brief Latency distribution of one pipeline stage over the most recent frames.
+ *
+ * Bucket 0 counts samples below 1us, bucket i samples in [2^(i-1), 2^i) us,
+ * and the last bucket everything slower than that.
+ */
+struct LatencyHistogram {
+    static constexpr size_t BUCKET_COUNT = 20;
+
+    std::array<uint32_t, BUCKET_COUNT> m_buckets{};
+    uint32_t m_samples = 0;
+
+    /**
+     * @brief Returns the upper bound of the bucket that contains the given percentile.
+     *
+     * @param percentile A value between 0 and 1, e.g. 0.99 for p99.
+     */
+    std::chrono::microseconds percentile(double percentile) const {
+        if (m_samples == 0)
+            return std::chrono::microseconds(0);
+
+        uint64_t target = static_cast<uint64_t>(percentile * m_samples + 0.5);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; i++) {
+            seen += m_buckets[i];
+            if (seen >= target && seen > 0)
+                return std::chrono::microseconds(1ll << i);
+        }
+        return std::chrono::microseconds(1ll << (BUCKET_COUNT - 1));
+    }
+};
+
+/**
+ * @brief A snapshot of the recorder pipeline, returned by Recorder::getStats.
+ *
+ * The struct crosses the event API by size, new fields must only be appended.
+ */
+struct RecorderStats {
+    // frames passed to writeFrame, writeFrames and submitFrame, including dropped ones
+    uint64_t m_framesSubmitted = 0;
+    // frames that made it into the encoder
+    uint64_t m_framesEncoded = 0;
+    // frames dropped because the asynchronous queue was full
+    uint64_t m_framesDropped = 0;
+    // frames waiting for the encoding thread
+    uint32_t m_queueDepth = 0;
+    // size of all packets handed to the muxer
+    uint64_t m_bytesWritten = 0;
+    // output bitrate over the last second of video, in bits per second
+    double m_bitrate = 0.0;
+
+    LatencyHistogram m_conversion;
+    LatencyHistogram m_filter;
+    // avcodec_send_frame and avcodec_receive_packet
+    LatencyHistogram m_encode;
+    LatencyHistogram m_mux;
+
+    // identical consecutive frames that weren't encoded, see RenderSettings::m_skipDuplicateFrames
+    uint64_t m_framesSkipped = 0;
+
+    // time the background writer spent writing each block to disk
+    LatencyHistogram m_diskWrite;
+    // muxed bytes waiting for the background writer
+    uint64_t m_pendingWriteBytes = 0;
+    // how often muxing had to wait because the write queue was full, storage is the bottleneck if this grows
+    uint64_t m_writeStalls = 0;
+
+    // encoded video held by the replay buffer, see RenderSettings::m_replayDuration
+    uint64_t m_replayBytes = 0;
+
+    // threading the encoder was opened with, see RenderSettings::m_encoderThreads
+    uint32_t m_encoderThreads = 0;
+    ThreadType m_encoderThreadType = ThreadType::AUTO;
+
+    // packets the replay buffer couldn't keep because their keyframe interval was bigger than RenderSettings::m_replayMaxBytes
+    uint64_t m_replayDroppedPackets = 0;
+};
+
+END_FFMPEG_NAMESPACE_V
@@ -1,7 +1,13 @@
 #pragma once
 
 #include <string>
+#include <chrono>
 #include <filesystem>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include "export.hpp"
 
 BEGIN_FFMPEG_NAMESPACE_V
@@ -309,6 +315,51 @@ enum class HardwareAccelerationType : int {
     D3D11VA = 7,
 };
 
+// Tuned encoder defaults, see RenderSettings::m_encoderProfile
+enum class EncoderProfile : int {
+    NONE = 0,
+    REALTIME,
+    BALANCED,
+    ARCHIVE,
+};
+
+// How the encoder spreads its work over threads, see RenderSettings::m_encoderThreadType
+enum class ThreadType : int {
+    AUTO = 0,
+    // single threaded, or a hardware encoder
+    NONE,
+    // several frames at once, highest throughput but adds a frame of latency per thread
+    FRAME,
+    // parts of one frame at once, no added latency
+    SLICE,
+    // the codec library manages its own threads (x264, libvpx, libaom, ...)
+    CODEC,
+};
+
+// Time spent in every stage of the pipeline for a single frame
+struct FrameTimings {
+    std::chrono::nanoseconds m_convert{};
+    std::chrono::nanoseconds m_filter{};
+    std::chrono::nanoseconds m_send{};
+    std::chrono::nanoseconds m_receive{};
+    std::chrono::nanoseconds m_mux{};
+};
+
+// Pass as RenderSettings::m_codec to use the best encoder that keeps up, see Recorder::selectCodec.
+// Until a configuration has been benchmarked, init uses a hardware or H.264 encoder instead
+constexpr std::string_view AUTO_CODEC = "auto";
+
+// Destination for the muxed output when it shouldn't go to a file
+struct OutputCallbacks {
+    // receives the muxed bytes, returning false aborts the recording
+    std::function<bool(std::span<uint8_t const>)> m_write;
+    // optional, moves the write position to an absolute offset. Without it the output is
+    // treated as a stream (e.g. a pipe) and the container must not need seeking
+    std::function<bool(int64_t)> m_seek;
+};
+
+// Fields are only ever appended, the event API copies as much of a caller's struct as it was built with.
+// A new field also has to be added to copySettings in src/event-api/events.cpp
 struct RenderSettings {
     HardwareAccelerationType m_hardwareAccelerationType = HardwareAccelerationType::NONE;
     PixelFormat m_pixelFormat = PixelFormat::RGB0;
@@ -320,6 +371,81 @@ struct RenderSettings {
     uint32_t m_height = 1080;
     uint16_t m_fps = 60;
     std::filesystem::path m_outputFile;
+
+    // Encode on a background thread, writeFrame only copies the frame into a queue
+    bool m_asyncEncode = false;
+    // Maximum amount of frames waiting to be encoded in asynchronous mode
+    uint32_t m_maxQueuedFrames = 8;
+    // Drop frames instead of blocking when the queue is full
+    bool m_dropFramesWhenFull = false;
+
+    // Threads used for pixel format conversion, 0 picks a count based on the resolution
+    uint32_t m_conversionThreads = 0;
+
+    // Codec private options passed to the encoder, e.g. {"preset", "ultrafast"}
+    std::unordered_map<std::string, std::string> m_encoderOptions;
+    // Fills in tuned per-codec options, entries in m_encoderOptions take precedence
+    EncoderProfile m_encoderProfile = EncoderProfile::NONE;
+
+    // Called after every encoded frame with its per-stage timings, runs on the encoding thread
+    std::function<void(const FrameTimings&)> m_timingCallback;
+
+    // Extra filters in FFmpeg filtergraph syntax, applied after m_colorspaceFilters, e.g. "hqdn3d,unsharp"
+    std::string m_filters;
+    // Threads used by the filter graph, 0 uses every core
+    uint32_t m_filterThreads = 0;
+
+    // Frames carry caller-supplied timestamps (writeFrame with timestampMicros) instead of
+    // being spaced 1/m_fps apart, m_fps is then only the nominal rate
+    bool m_variableFrameRate = false;
+
+    // Don't encode frames identical to the previous one, the previous frame is shown longer instead.
+    // Only every other row is compared, so changes that are a single row tall can be missed
+    bool m_skipDuplicateFrames = false;
+
+    // Write MP4/MOV output as self-contained fragments: memory stays flat, stop() is instant
+    // and the file is still playable if the game crashes mid-recording
+    bool m_fragmentedOutput = false;
+
+    // Container format name as used by FFmpeg ("mp4", "matroska", "mpegts", ...). Guessed from
+    // m_outputFile when empty, required for callback and memory output
+    std::string m_outputFormat;
+    // Send the output to these callbacks instead of m_outputFile
+    OutputCallbacks m_outputCallbacks;
+    // Or keep the output in this caller-owned buffer, it must stay alive until stop() returns
+    std::vector<uint8_t>* m_outputBuffer = nullptr;
+
+    // Start a new file every this many seconds and/or bytes of output (0 disables), split at a keyframe.
+    // Segments are named after m_outputFile with their index appended, e.g. "recording_000.mp4"
+    double m_segmentDuration = 0.0;
+    uint64_t m_segmentSize = 0;
+    // Called with the path of every finished segment, runs on the encoding thread
+    std::function<void(const std::filesystem::path&)> m_segmentCallback;
+
+    // Keep the last this many seconds of encoded video in memory instead of writing an output,
+    // Recorder::saveReplay writes them to a file. 0 disables
+    double m_replayDuration = 0.0;
+    // Memory budget of the replay buffer, the oldest video is dropped early when it's exceeded
+    size_t m_replayMaxBytes = 256 * 1024 * 1024;
+
+    // Encoder of a live audio track fed with Recorder::writeAudio, e.g. "aac" or "libopus". Empty disables
+    std::string m_audioCodec;
+    // Sample rate of the interleaved stereo samples passed to writeAudio
+    uint32_t m_audioSampleRate = 44100;
+    int64_t m_audioBitrate = 128000;
+
+    // Offline rendering only: encode chunks of this many frames in parallel, each with its own encoder
+    // instance starting at a keyframe. 0 disables. Every chunk in flight keeps its frames in memory
+    uint32_t m_chunkFrames = 0;
+    // Encoder instances running at once in chunked mode, 0 uses every core, or 2 for hardware encoders
+    uint32_t m_chunkEncoders = 0;
+
+    // Encoder threads, 0 picks a count from the core count, resolution and codec
+    uint32_t m_encoderThreads = 0;
+    // FRAME or SLICE to force a threading mode, AUTO prefers slices where the codec supports them
+    ThreadType m_encoderThreadType = ThreadType::AUTO;
+    // Cores left to the game's main and render threads when picking the encoder thread count
+    uint32_t m_reservedCores = 2;
 };
 
 END_FFMPEG_NAMESPACE_V
\ No newline at end of file
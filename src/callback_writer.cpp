@@ -0,0 +1,110 @@
+#include "callback_writer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+extern "C" {
+    #include <libavformat/avio.h>
+    #include <libavutil/error.h>
+    #include <libavutil/mem.h>
+}
+
+namespace ffmpeg::io {
+
+CallbackWriter::~CallbackWriter() {
+    (void) close();
+}
+
+geode::Result<> CallbackWriter::open(OutputCallbacks callbacks) {
+    if (!callbacks.m_write)
+        return geode::Err("Output callbacks need a write function.");
+
+    uint8_t* buffer = static_cast<uint8_t*>(av_malloc(BUFFER_SIZE));
+    if (!buffer)
+        return geode::Err("Could not allocate output buffer.");
+
+    bool seekable = static_cast<bool>(callbacks.m_seek);
+    m_context = avio_alloc_context(buffer, BUFFER_SIZE, 1, this, nullptr, &CallbackWriter::writePacket, seekable ? &CallbackWriter::seek : nullptr);
+    if (!m_context) {
+        av_free(buffer);
+        return geode::Err("Could not allocate output context.");
+    }
+
+    m_context->seekable = seekable ? AVIO_SEEKABLE_NORMAL : 0;
+    m_callbacks = std::move(callbacks);
+    m_position = 0;
+    m_size = 0;
+    m_failed = false;
+
+    return geode::Ok();
+}
+
+geode::Result<> CallbackWriter::close() {
+    if (!m_context)
+        return geode::Ok();
+
+    avio_flush(m_context);
+    av_freep(&m_context->buffer);
+    avio_context_free(&m_context);
+
+    if (m_failed)
+        return geode::Err("The output callback failed to write data.");
+    return geode::Ok();
+}
+
+int CallbackWriter::writePacket(void* opaque, const uint8_t* data, int size) {
+    auto self = static_cast<CallbackWriter*>(opaque);
+
+    if (self->m_failed || !self->m_callbacks.m_write(std::span(data, static_cast<size_t>(size)))) {
+        self->m_failed = true;
+        return AVERROR(EIO);
+    }
+
+    self->m_position += size;
+    self->m_size = std::max(self->m_size, self->m_position);
+    return size;
+}
+
+int64_t CallbackWriter::seek(void* opaque, int64_t offset, int whence) {
+    auto self = static_cast<CallbackWriter*>(opaque);
+
+    int64_t position;
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return self->m_size;
+        case SEEK_SET: position = offset; break;
+        case SEEK_CUR: position = self->m_position + offset; break;
+        case SEEK_END: position = self->m_size + offset; break;
+        default: return AVERROR(EINVAL);
+    }
+
+    if (position < 0 || !self->m_callbacks.m_seek(position))
+        return AVERROR(EIO);
+
+    self->m_position = position;
+    return position;
+}
+
+OutputCallbacks getMemoryCallbacks(std::vector<uint8_t>* buffer) {
+    buffer->clear();
+    auto position = std::make_shared<size_t>(0);
+
+    OutputCallbacks callbacks;
+    callbacks.m_write = [buffer, position](std::span<uint8_t const> data) {
+        size_t end = *position + data.size();
+        if (buffer->size() < end)
+            buffer->resize(end);
+
+        std::memcpy(buffer->data() + *position, data.data(), data.size());
+        *position = end;
+        return true;
+    };
+    callbacks.m_seek = [position](int64_t offset) {
+        *position = static_cast<size_t>(offset);
+        return true;
+    };
+    return callbacks;
+}
+
+}
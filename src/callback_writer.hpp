@@ -0,0 +1,42 @@
+#pragma once
+
+#include "render_settings.hpp"
+
+#include <Geode/Result.hpp>
+
+class AVIOContext;
+
+namespace ffmpeg::io {
+
+/**
+ * Muxer output that hands the muxed bytes to user callbacks instead of a file.
+ * Without a seek callback the output is a plain stream, so only containers that
+ * don't need to go back (matroska, fragmented mp4, mpegts) can be used.
+ */
+class CallbackWriter {
+public:
+    static constexpr size_t BUFFER_SIZE = 256 * 1024;
+
+    ~CallbackWriter();
+
+    geode::Result<> open(OutputCallbacks callbacks);
+    // flushes the context, all data has been delivered once this returns
+    geode::Result<> close();
+
+    AVIOContext* getContext() const { return m_context; }
+
+private:
+    static int writePacket(void* opaque, const uint8_t* data, int size);
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+
+    AVIOContext* m_context = nullptr;
+    OutputCallbacks m_callbacks;
+    int64_t m_position = 0;
+    int64_t m_size = 0;
+    bool m_failed = false;
+};
+
+// callbacks that write into a caller-owned, growable buffer
+OutputCallbacks getMemoryCallbacks(std::vector<uint8_t>* buffer);
+
+}
@@ -0,0 +1,202 @@
+#include "chunk_encoder.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/frame.h>
+}
+
+namespace ffmpeg::chunk {
+
+ChunkEncoder::Chunk::~Chunk() {
+    for (AVFrame*& frame : m_frames)
+        av_frame_free(&frame);
+    for (AVPacket*& packet : m_packets)
+        av_packet_free(&packet);
+}
+
+ChunkEncoder::ChunkEncoder(size_t workers, size_t chunkFrames, OpenEncoder open, PacketSink sink)
+    : m_open(std::move(open)), m_sink(std::move(sink)),
+      m_workerCount(std::max<size_t>(workers, 1)), m_chunkFrames(std::max<size_t>(chunkFrames, 1)),
+      m_lastDts(AV_NOPTS_VALUE) {
+    for (size_t i = 0; i < m_workerCount; i++)
+        m_workers.emplace_back(&ChunkEncoder::workerLoop, this);
+}
+
+ChunkEncoder::~ChunkEncoder() {
+    stopWorkers();
+}
+
+void ChunkEncoder::stopWorkers() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopRequested = true;
+        m_jobs.clear();
+    }
+    m_jobCondition.notify_all();
+
+    for (std::thread& worker : m_workers) {
+        if (worker.joinable())
+            worker.join();
+    }
+    m_workers.clear();
+}
+
+geode::Result<> ChunkEncoder::send(const AVFrame* frame) {
+    if (!m_current)
+        m_current = std::make_unique<Chunk>();
+
+    AVFrame* copy = av_frame_alloc();
+    if (!copy)
+        return geode::Err("Could not allocate frame.");
+
+    // borrowed data is copied, pooled buffers are only referenced
+    if (int ret = av_frame_ref(copy, frame); ret < 0) {
+        av_frame_free(&copy);
+        return geode::Err("Could not reference frame: " + utils::getErrorString(ret));
+    }
+
+    m_current->m_frames.push_back(copy);
+    if (m_current->m_frames.size() < m_chunkFrames)
+        return geode::Ok();
+
+    return dispatch();
+}
+
+geode::Result<> ChunkEncoder::finish() {
+    if (m_current && !m_current->m_frames.empty()) {
+        if (geode::Result<> res = dispatch(); res.isErr())
+            return res;
+    }
+
+    geode::Result<> res = drain(0);
+    stopWorkers();
+    return res;
+}
+
+geode::Result<> ChunkEncoder::dispatch() {
+    // one chunk per worker plus the one being filled keeps memory bounded
+    if (geode::Result<> res = drain(m_workerCount - 1); res.isErr())
+        return res;
+
+    std::shared_ptr<Chunk> chunk(m_current.release());
+    {
+        std::lock_guard lock(m_mutex);
+        m_inFlight.push_back(chunk);
+        m_jobs.push_back(chunk);
+    }
+    m_jobCondition.notify_one();
+
+    return geode::Ok();
+}
+
+geode::Result<> ChunkEncoder::drain(size_t maxInFlight) {
+    while (true) {
+        std::shared_ptr<Chunk> chunk;
+        {
+            // finished chunks are handed on right away, unfinished ones only waited for if there are too many
+            std::unique_lock lock(m_mutex);
+            if (m_inFlight.empty() || (!m_inFlight.front()->m_done && m_inFlight.size() <= maxInFlight))
+                return geode::Ok();
+
+            m_doneCondition.wait(lock, [this] { return m_inFlight.front()->m_done; });
+            chunk = m_inFlight.front();
+            m_inFlight.pop_front();
+        }
+
+        if (!chunk->m_error.empty())
+            return geode::Err(chunk->m_error);
+
+        for (AVPacket* packet : chunk->m_packets) {
+            // an encoder delay can start a chunk's decode timestamps before its first frame. they are moved up
+            // as long as that doesn't pass a presentation timestamp, which is never touched
+            if (packet->dts != AV_NOPTS_VALUE) {
+                if (m_lastDts != AV_NOPTS_VALUE && packet->dts <= m_lastDts)
+                    packet->dts = m_lastDts + 1;
+                if (packet->pts != AV_NOPTS_VALUE && packet->pts < packet->dts)
+                    return geode::Err("Chunk timestamps overlap, the encoder reorders frames across chunks.");
+                m_lastDts = packet->dts;
+            }
+
+            if (geode::Result<> res = m_sink(packet); res.isErr())
+                return res;
+        }
+    }
+}
+
+void ChunkEncoder::workerLoop() {
+    while (true) {
+        std::shared_ptr<Chunk> chunk;
+        {
+            std::unique_lock lock(m_mutex);
+            m_jobCondition.wait(lock, [this] { return m_stopRequested || !m_jobs.empty(); });
+            if (m_jobs.empty())
+                return;
+
+            chunk = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        encodeChunk(*chunk);
+
+        {
+            std::lock_guard lock(m_mutex);
+            chunk->m_done = true;
+        }
+        m_doneCondition.notify_all();
+    }
+}
+
+void ChunkEncoder::encodeChunk(Chunk& chunk) {
+    geode::Result<AVCodecContext*> opened = m_open();
+    if (opened.isErr()) {
+        chunk.m_error = opened.unwrapErr();
+        return;
+    }
+
+    AVCodecContext* context = opened.unwrap();
+    AVPacket* packet = av_packet_alloc();
+
+    auto receive = [&]() -> int {
+        int ret = 0;
+        while (ret >= 0) {
+            ret = avcodec_receive_packet(context, packet);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+                return 0;
+            if (ret < 0)
+                return ret;
+
+            AVPacket* stored = av_packet_alloc();
+            av_packet_move_ref(stored, packet);
+            chunk.m_packets.push_back(stored);
+        }
+        return ret;
+    };
+
+    int ret = packet ? 0 : AVERROR(ENOMEM);
+    for (size_t i = 0; i < chunk.m_frames.size() && ret >= 0; i++) {
+        AVFrame* frame = chunk.m_frames[i];
+        // the chunk has to be decodable on its own
+        if (i == 0)
+            frame->pict_type = AV_PICTURE_TYPE_I;
+
+        ret = avcodec_send_frame(context, frame);
+        av_frame_free(&chunk.m_frames[i]);
+
+        if (ret >= 0)
+            ret = receive();
+    }
+
+    if (ret >= 0 && (ret = avcodec_send_frame(context, nullptr)) >= 0)
+        ret = receive();
+
+    if (ret < 0)
+        chunk.m_error = "Error while encoding chunk: " + utils::getErrorString(ret);
+
+    av_packet_free(&packet);
+    avcodec_free_context(&context);
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Geode/Result.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AVCodecContext;
+class AVFrame;
+class AVPacket;
+
+namespace ffmpeg::chunk {
+
+/**
+ * Splits the frames into chunks that are encoded in parallel, every chunk by its own
+ * encoder instance starting with a keyframe. The packets are handed on in order once
+ * a chunk and all chunks before it are done, with decode timestamps made continuous
+ * across chunk boundaries.
+ */
+class ChunkEncoder {
+public:
+    // opens a fresh encoder for a chunk, must produce a closed GOP stream without B-frames
+    using OpenEncoder = std::function<geode::Result<AVCodecContext*>()>;
+    // receives every packet in order, on the thread calling send or finish
+    using PacketSink = std::function<geode::Result<>(AVPacket*)>;
+
+    ChunkEncoder(size_t workers, size_t chunkFrames, OpenEncoder open, PacketSink sink);
+    ~ChunkEncoder();
+
+    // takes a reference to the frame, blocks while too many chunks are in flight
+    geode::Result<> send(const AVFrame* frame);
+    // encodes the last partial chunk and waits until every packet was handed on
+    geode::Result<> finish();
+
+private:
+    struct Chunk {
+        std::vector<AVFrame*> m_frames;
+        std::vector<AVPacket*> m_packets;
+        std::string m_error;
+        bool m_done = false;
+
+        ~Chunk();
+    };
+
+    void workerLoop();
+    void encodeChunk(Chunk& chunk);
+    geode::Result<> dispatch();
+    geode::Result<> drain(size_t maxInFlight);
+    void stopWorkers();
+
+    OpenEncoder m_open;
+    PacketSink m_sink;
+    size_t m_workerCount;
+    size_t m_chunkFrames;
+
+    // only touched by the sending thread
+    std::unique_ptr<Chunk> m_current;
+    int64_t m_lastDts;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_jobCondition;
+    std::condition_variable m_doneCondition;
+    // in submission order, the front is handed on first
+    std::deque<std::shared_ptr<Chunk>> m_inFlight;
+    std::deque<std::shared_ptr<Chunk>> m_jobs;
+    bool m_stopRequested = false;
+};
+
+}
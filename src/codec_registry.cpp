@@ -0,0 +1,254 @@
+#include "codec_registry.hpp"
+
+#include <Geode/loader/Mod.hpp>
+#include <Geode/loader/Log.hpp>
+#include <Geode/utils/file.hpp>
+#include <matjson.hpp>
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/avutil.h>
+}
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <optional>
+
+using namespace geode::prelude;
+
+namespace ffmpeg::codecs {
+
+constexpr auto CACHE_LIFETIME = std::chrono::hours(24 * 7);
+// big enough for every encoder's minimum size and alignment, small enough to open in a few milliseconds
+constexpr int PROBE_SIZE = 256;
+
+static std::shared_future<Registry> s_registry;
+static std::once_flag s_registryStarted;
+static std::mutex s_selectionMutex;
+
+// 64-bit FNV-1a, unlike std::hash the result is the same in every run and on every standard library
+static uint64_t hashString(std::string_view text) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : text) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// the same build can be configured with different external libraries, so the configuration is part of the key
+static std::string getBuildKey() {
+    return std::string(av_version_info()) + "-" + std::to_string(avcodec_version()) + "-"
+        + std::to_string(hashString(avcodec_configuration())) + "-"
+        + Mod::get()->getVersion().toVString();
+}
+
+static int64_t getTimestamp() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool isRecorderCodec(AVCodecID id) {
+    return id == AV_CODEC_ID_H264 || id == AV_CODEC_ID_HEVC || id == AV_CODEC_ID_VP8 || id == AV_CODEC_ID_VP9
+        || id == AV_CODEC_ID_AV1 || id == AV_CODEC_ID_MPEG4;
+}
+
+static bool probeEncoder(const AVCodec* codec) {
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    if (!context)
+        return false;
+
+    context->width = PROBE_SIZE;
+    context->height = PROBE_SIZE;
+    context->time_base = AVRational{1, 30};
+    context->framerate = AVRational{30, 1};
+    context->bit_rate = 1000000;
+    context->pix_fmt = codec->pix_fmts ? codec->pix_fmts[0] : AV_PIX_FMT_YUV420P;
+
+    // same as in Recorder::init, the surface format needs a surface the probe doesn't have
+    for (const AVPixelFormat* format = codec->pix_fmts; format && *format != AV_PIX_FMT_NONE; format++) {
+        if (*format == AV_PIX_FMT_MEDIACODEC) {
+            context->pix_fmt = AV_PIX_FMT_NV12;
+            break;
+        }
+    }
+
+    int ret = avcodec_open2(context, codec, nullptr);
+    avcodec_free_context(&context);
+    return ret >= 0;
+}
+
+static std::vector<CodecInfo> probeCodecs() {
+    std::vector<CodecInfo> codecs;
+
+    void* iter = nullptr;
+    const AVCodec* codec;
+    while ((codec = av_codec_iterate(&iter))) {
+        // opening an encoder can take a while, so only the ones the recorder can be used with are probed
+        if (codec->type != AVMEDIA_TYPE_VIDEO || !av_codec_is_encoder(codec) || !isRecorderCodec(codec->id))
+            continue;
+
+        CodecInfo& info = codecs.emplace_back();
+        info.m_name = codec->name;
+        info.m_longName = codec->long_name ? codec->long_name : "";
+        for (const AVPixelFormat* format = codec->pix_fmts; format && *format != AV_PIX_FMT_NONE; format++)
+            info.m_pixelFormats.push_back(static_cast<PixelFormat>(*format));
+
+        info.m_hardware = codec->capabilities & AV_CODEC_CAP_HARDWARE;
+        info.m_frameThreads = codec->capabilities & AV_CODEC_CAP_FRAME_THREADS;
+        info.m_sliceThreads = codec->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+        info.m_codecThreads = codec->capabilities & AV_CODEC_CAP_OTHER_THREADS;
+        info.m_flushable = codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH;
+        info.m_working = probeEncoder(codec);
+    }
+
+    return codecs;
+}
+
+static std::optional<std::vector<CodecInfo>> readCache(const std::filesystem::path& path, const std::string& build) {
+    auto contents = geode::utils::file::readString(path);
+    if (!contents)
+        return std::nullopt;
+
+    auto parsed = matjson::parse(contents.unwrap());
+    if (!parsed)
+        return std::nullopt;
+
+    const matjson::Value& json = parsed.unwrap();
+    if (json["build"].asString().unwrapOr("") != build)
+        return std::nullopt;
+
+    auto age = std::chrono::seconds(getTimestamp() - json["probed"].asInt().unwrapOr(0));
+    if (age < std::chrono::seconds(0) || age > CACHE_LIFETIME)
+        return std::nullopt;
+
+    std::vector<CodecInfo> codecs;
+    for (const matjson::Value& entry : json["codecs"]) {
+        CodecInfo& info = codecs.emplace_back();
+        info.m_name = entry["name"].asString().unwrapOr("");
+        info.m_longName = entry["long_name"].asString().unwrapOr("");
+        for (const matjson::Value& format : entry["pixel_formats"])
+            info.m_pixelFormats.push_back(static_cast<PixelFormat>(format.asInt().unwrapOr(-1)));
+
+        info.m_hardware = entry["hardware"].asBool().unwrapOr(false);
+        info.m_frameThreads = entry["frame_threads"].asBool().unwrapOr(false);
+        info.m_sliceThreads = entry["slice_threads"].asBool().unwrapOr(false);
+        info.m_codecThreads = entry["codec_threads"].asBool().unwrapOr(false);
+        info.m_flushable = entry["flushable"].asBool().unwrapOr(false);
+        info.m_working = entry["working"].asBool().unwrapOr(false);
+    }
+
+    return codecs;
+}
+
+static void writeCache(const std::filesystem::path& path, const std::string& build, const std::vector<CodecInfo>& codecs) {
+    matjson::Value entries = matjson::Value::array();
+    for (const CodecInfo& info : codecs) {
+        matjson::Value formats = matjson::Value::array();
+        for (PixelFormat format : info.m_pixelFormats)
+            formats.push(static_cast<int>(format));
+
+        matjson::Value entry;
+        entry["name"] = info.m_name;
+        entry["long_name"] = info.m_longName;
+        entry["pixel_formats"] = formats;
+        entry["hardware"] = info.m_hardware;
+        entry["frame_threads"] = info.m_frameThreads;
+        entry["slice_threads"] = info.m_sliceThreads;
+        entry["codec_threads"] = info.m_codecThreads;
+        entry["flushable"] = info.m_flushable;
+        entry["working"] = info.m_working;
+        entries.push(entry);
+    }
+
+    matjson::Value json;
+    json["build"] = build;
+    json["probed"] = getTimestamp();
+    json["codecs"] = entries;
+
+    if (auto res = geode::utils::file::writeString(path, json.dump()); !res)
+        log::warn("Failed to write codec cache: {}", res.unwrapErr());
+}
+
+static Registry buildRegistry() {
+    std::filesystem::path cacheFile = Mod::get()->getSaveDir() / "codecs.json";
+    std::string build = getBuildKey();
+
+    Registry registry;
+    if (auto cached = readCache(cacheFile, build)) {
+        registry.m_codecs = std::move(*cached);
+    } else {
+        auto start = std::chrono::steady_clock::now();
+        registry.m_codecs = probeCodecs();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        log::info("Probed {} video encoders in {}ms", registry.m_codecs.size(), elapsed.count());
+        writeCache(cacheFile, build, registry.m_codecs);
+    }
+
+    for (const CodecInfo& info : registry.m_codecs) {
+        if (info.m_working && !info.m_pixelFormats.empty())
+            registry.m_available.push_back(info.m_name);
+    }
+
+    return registry;
+}
+
+void loadRegistry() {
+    std::call_once(s_registryStarted, [] {
+        s_registry = std::async(std::launch::async, &buildRegistry).share();
+    });
+}
+
+const Registry& getRegistry() {
+    loadRegistry();
+    return s_registry.get();
+}
+
+static std::filesystem::path getSelectionFile() {
+    return Mod::get()->getSaveDir() / "encoder_selection.json";
+}
+
+// the selections made with the current build, empty if there are none yet
+static matjson::Value readSelections() {
+    auto contents = geode::utils::file::readString(getSelectionFile());
+    if (!contents)
+        return matjson::Value();
+
+    auto parsed = matjson::parse(contents.unwrap());
+    if (!parsed)
+        return matjson::Value();
+
+    const matjson::Value& json = parsed.unwrap();
+    if (json["build"].asString().unwrapOr("") != getBuildKey())
+        return matjson::Value();
+
+    return json["selections"];
+}
+
+std::optional<std::string> getCachedSelection(const std::string& key) {
+    std::lock_guard lock(s_selectionMutex);
+    const matjson::Value selections = readSelections();
+    auto codec = selections[key].asString();
+    if (!codec)
+        return std::nullopt;
+    return codec.unwrap();
+}
+
+void cacheSelection(const std::string& key, const std::string& codec) {
+    std::lock_guard lock(s_selectionMutex);
+    matjson::Value selections = readSelections();
+    selections[key] = codec;
+
+    matjson::Value json;
+    json["build"] = getBuildKey();
+    json["selections"] = selections;
+
+    if (auto res = geode::utils::file::writeString(getSelectionFile(), json.dump()); !res)
+        log::warn("Failed to write encoder selection cache: {}", res.unwrapErr());
+}
+
+}
+
+$execute {
+    ffmpeg::codecs::loadRegistry();
+}
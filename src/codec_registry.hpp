@@ -0,0 +1,32 @@
+#pragma once
+
+#include "codec_info.hpp"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ffmpeg::codecs {
+
+struct Registry {
+    // every encoder in this FFmpeg build for a codec the recorder is meant for (H.264, HEVC, VP8, VP9, AV1, MPEG-4)
+    std::vector<CodecInfo> m_codecs;
+    // names of the working ones
+    std::vector<std::string> m_available;
+};
+
+/**
+ * Starts building the registry on a background thread, does nothing if it was already started.
+ * The probe results are cached in the save directory and only redone when the FFmpeg build
+ * changes or the cache is older than CACHE_LIFETIME, so a driver installed later is picked up eventually.
+ */
+void loadRegistry();
+
+// waits for the registry if it is still being built
+const Registry& getRegistry();
+
+// the encoder an earlier auto selection picked for this key, forgotten when the FFmpeg build changes
+std::optional<std::string> getCachedSelection(const std::string& key);
+void cacheSelection(const std::string& key, const std::string& codec);
+
+}
@@ -0,0 +1,118 @@
+#include "encoder_profiles.hpp"
+
+namespace ffmpeg::profiles {
+
+struct ProfileTable {
+    std::vector<Option> realtime;
+    std::vector<Option> balanced;
+    std::vector<Option> archive;
+};
+
+static const ProfileTable* getTable(std::string_view codec) {
+    static const ProfileTable x264 = {
+        { {"preset", "ultrafast"}, {"tune", "zerolatency"} },
+        { {"preset", "veryfast"} },
+        { {"preset", "slow"} },
+    };
+    static const ProfileTable x265 = {
+        { {"preset", "ultrafast"}, {"tune", "zerolatency"} },
+        { {"preset", "fast"} },
+        { {"preset", "slow"} },
+    };
+    static const ProfileTable openh264 = {
+        { {"allow_skip_frames", "0"}, {"coder", "cavlc"} },
+        { {"coder", "cabac"} },
+        { {"coder", "cabac"}, {"rc_mode", "quality"} },
+    };
+    static const ProfileTable nvenc = {
+        { {"preset", "p1"}, {"tune", "ull"}, {"rc-lookahead", "0"}, {"zerolatency", "1"} },
+        { {"preset", "p4"}, {"tune", "hq"}, {"rc-lookahead", "8"} },
+        { {"preset", "p7"}, {"tune", "hq"}, {"rc-lookahead", "32"}, {"multipass", "fullres"}, {"spatial-aq", "1"} },
+    };
+    static const ProfileTable amf = {
+        { {"usage", "ultralowlatency"}, {"quality", "speed"} },
+        { {"usage", "transcoding"}, {"quality", "balanced"} },
+        { {"usage", "transcoding"}, {"quality", "quality"} },
+    };
+    static const ProfileTable qsv = {
+        { {"preset", "veryfast"}, {"async_depth", "1"} },
+        { {"preset", "medium"} },
+        { {"preset", "veryslow"} },
+    };
+    static const ProfileTable mediaFoundation = {
+        { {"scenario", "display_remoting"} },
+        { {"scenario", "camera_record"} },
+        { {"scenario", "archive"} },
+    };
+    static const ProfileTable videoToolbox = {
+        { {"realtime", "1"}, {"prio_speed", "1"} },
+        { {"realtime", "0"} },
+        { {"realtime", "0"}, {"prio_speed", "0"} },
+    };
+    static const ProfileTable vpx = {
+        { {"deadline", "realtime"}, {"cpu-used", "8"}, {"lag-in-frames", "0"} },
+        { {"deadline", "good"}, {"cpu-used", "4"} },
+        { {"deadline", "good"}, {"cpu-used", "1"}, {"auto-alt-ref", "1"} },
+    };
+    static const ProfileTable vpxVp9 = {
+        { {"deadline", "realtime"}, {"cpu-used", "8"}, {"lag-in-frames", "0"}, {"row-mt", "1"} },
+        { {"deadline", "good"}, {"cpu-used", "4"}, {"row-mt", "1"} },
+        { {"deadline", "good"}, {"cpu-used", "1"}, {"row-mt", "1"}, {"auto-alt-ref", "1"} },
+    };
+    static const ProfileTable aom = {
+        { {"usage", "realtime"}, {"cpu-used", "8"}, {"row-mt", "1"}, {"lag-in-frames", "0"}, {"tiles", "2x2"} },
+        { {"usage", "good"}, {"cpu-used", "6"}, {"row-mt", "1"} },
+        { {"usage", "good"}, {"cpu-used", "3"}, {"row-mt", "1"} },
+    };
+    static const ProfileTable svtav1 = {
+        { {"preset", "12"} },
+        { {"preset", "8"} },
+        { {"preset", "4"} },
+    };
+    static const ProfileTable rav1e = {
+        { {"speed", "10"} },
+        { {"speed", "6"} },
+        { {"speed", "3"} },
+    };
+    static const ProfileTable mpeg4 = {
+        { {"mbd", "simple"} },
+        { {"mbd", "bits"} },
+        { {"mbd", "rd"}, {"trellis", "1"} },
+    };
+
+    auto endsWith = [&](std::string_view suffix) {
+        return codec.size() >= suffix.size() && codec.substr(codec.size() - suffix.size()) == suffix;
+    };
+
+    if (codec == "libx264" || codec == "libx264rgb") return &x264;
+    if (codec == "libx265") return &x265;
+    if (codec == "libopenh264") return &openh264;
+    if (codec == "libvpx") return &vpx;
+    if (codec == "libvpx-vp9") return &vpxVp9;
+    if (codec == "libaom-av1") return &aom;
+    if (codec == "libsvtav1") return &svtav1;
+    if (codec == "librav1e") return &rav1e;
+    if (codec == "mpeg4") return &mpeg4;
+    if (endsWith("_nvenc")) return &nvenc;
+    if (endsWith("_amf")) return &amf;
+    if (endsWith("_qsv")) return &qsv;
+    if (endsWith("_mf")) return &mediaFoundation;
+    if (endsWith("_videotoolbox")) return &videoToolbox;
+
+    return nullptr;
+}
+
+std::vector<Option> getProfileOptions(std::string_view codec, EncoderProfile profile) {
+    const ProfileTable* table = getTable(codec);
+    if (!table)
+        return {};
+
+    switch (profile) {
+        case EncoderProfile::REALTIME: return table->realtime;
+        case EncoderProfile::BALANCED: return table->balanced;
+        case EncoderProfile::ARCHIVE: return table->archive;
+        default: return {};
+    }
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "render_settings.hpp"
+
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ffmpeg::profiles {
+
+using Option = std::pair<const char*, const char*>;
+
+// returns the codec private options for a profile, empty if the codec has no tuned defaults
+std::vector<Option> getProfileOptions(std::string_view codec, EncoderProfile profile);
+
+}
@@ -2,16 +2,58 @@
 #include "recorder.hpp"
 #include "audio_mixer.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace geode::prelude;
 
+using ffmpeg::RenderSettings;
+
+// end of a field within RenderSettings, offsetof isn't allowed on a type that isn't standard-layout
+template <class T>
+static size_t getFieldEnd(T RenderSettings::* field) {
+    static const RenderSettings layout;
+    return reinterpret_cast<const char*>(&(layout.*field)) - reinterpret_cast<const char*>(&layout) + sizeof(T);
+}
+
+template <class... T>
+static void copyFields(RenderSettings& dst, const RenderSettings& src, size_t size, T RenderSettings::*... fields) {
+    ((getFieldEnd(fields) <= size ? void(dst.*fields = src.*fields) : void()), ...);
+}
+
+// the caller's struct may be older and smaller than ours, fields it doesn't have keep their defaults
+static RenderSettings copySettings(const RenderSettings& settings, size_t size) {
+    RenderSettings copy;
+    copyFields(copy, settings, size,
+        &RenderSettings::m_hardwareAccelerationType, &RenderSettings::m_pixelFormat, &RenderSettings::m_codec,
+        &RenderSettings::m_colorspaceFilters, &RenderSettings::m_doVerticalFlip, &RenderSettings::m_bitrate,
+        &RenderSettings::m_width, &RenderSettings::m_height, &RenderSettings::m_fps, &RenderSettings::m_outputFile,
+        &RenderSettings::m_asyncEncode, &RenderSettings::m_maxQueuedFrames, &RenderSettings::m_dropFramesWhenFull,
+        &RenderSettings::m_conversionThreads,
+        &RenderSettings::m_encoderOptions, &RenderSettings::m_encoderProfile,
+        &RenderSettings::m_timingCallback,
+        &RenderSettings::m_filters, &RenderSettings::m_filterThreads,
+        &RenderSettings::m_variableFrameRate,
+        &RenderSettings::m_skipDuplicateFrames,
+        &RenderSettings::m_fragmentedOutput,
+        &RenderSettings::m_outputFormat, &RenderSettings::m_outputCallbacks, &RenderSettings::m_outputBuffer,
+        &RenderSettings::m_segmentDuration, &RenderSettings::m_segmentSize, &RenderSettings::m_segmentCallback,
+        &RenderSettings::m_replayDuration, &RenderSettings::m_replayMaxBytes,
+        &RenderSettings::m_audioCodec, &RenderSettings::m_audioSampleRate, &RenderSettings::m_audioBitrate,
+        &RenderSettings::m_chunkFrames, &RenderSettings::m_chunkEncoders,
+        &RenderSettings::m_encoderThreads, &RenderSettings::m_encoderThreadType, &RenderSettings::m_reservedCores);
+    return copy;
+}
+
 $execute {
     using namespace ffmpeg::events::impl;
 
     FetchVTableEvent().listen([](VTable& vtable, size_t version) {
         vtable.createRecorder = +[]() -> void* { return new ffmpeg::Recorder; };
         vtable.deleteRecorder = +[](void* ptr) { delete (ffmpeg::Recorder*)ptr; };
+        // version 1 callers pass no size, only the original fields are safe to read
         vtable.initRecorder = +[](void* ptr, const ffmpeg::RenderSettings& settings) -> Result<> {
-            return ((ffmpeg::Recorder*)ptr)->init(settings);
+            return ((ffmpeg::Recorder*)ptr)->init(copySettings(settings, getFieldEnd(&RenderSettings::m_outputFile)));
         };
         vtable.stopRecorder = +[](void* ptr) { ((ffmpeg::Recorder*)ptr)->stop(); };
         vtable.writeFrame = +[](void* ptr, std::span<uint8_t const> frameData) -> Result<> {
@@ -22,6 +64,63 @@ $execute {
         vtable.mixVideoAudio = &ffmpeg::AudioMixer::mixVideoAudio;
         vtable.mixVideoRaw = &ffmpeg::AudioMixer::mixVideoRaw;
 
+        // older callers pass a smaller vtable, don't write past it
+        if (version < 2)
+            return ListenerResult::Stop;
+
+        vtable.initRecorderSized = +[](void* ptr, const ffmpeg::RenderSettings& settings, size_t size) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->init(copySettings(settings, size));
+        };
+        vtable.getRecorderStatus = +[](void* ptr) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->getStatus();
+        };
+
+        vtable.writeFrameOwned = +[](void* ptr, std::vector<uint8_t>&& frameData) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->writeFrame(std::move(frameData));
+        };
+
+        vtable.acquireFrame = +[](void* ptr) -> Result<ffmpeg::FrameHandle> {
+            return ((ffmpeg::Recorder*)ptr)->acquireFrame();
+        };
+        vtable.submitFrame = +[](void* ptr, ffmpeg::FrameHandle& handle) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->submitFrame(handle);
+        };
+        vtable.releaseFrame = +[](void* ptr, ffmpeg::FrameHandle& handle) {
+            ((ffmpeg::Recorder*)ptr)->releaseFrame(handle);
+        };
+
+        vtable.writeFrames = +[](void* ptr, std::span<std::span<uint8_t const> const> frames) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->writeFrames(frames);
+        };
+
+        // the caller's struct may be older and smaller than ours
+        vtable.getRecorderStats = +[](void* ptr, ffmpeg::RecorderStats* stats, size_t size) {
+            ffmpeg::RecorderStats current = ((ffmpeg::Recorder*)ptr)->getStats();
+            std::memcpy(stats, &current, std::min(size, sizeof(current)));
+        };
+
+        vtable.writeFrameTimed = +[](void* ptr, std::span<uint8_t const> frameData, int64_t timestampMicros) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->writeFrame(frameData, timestampMicros);
+        };
+
+        vtable.saveReplay = +[](void* ptr, const std::filesystem::path& path) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->saveReplay(path);
+        };
+
+        vtable.writeAudio = +[](void* ptr, std::span<float const> samples, int64_t timestampMicros) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->writeAudio(samples, timestampMicros);
+        };
+
+        vtable.restartRecorder = +[](void* ptr, const std::filesystem::path& path) -> Result<> {
+            return ((ffmpeg::Recorder*)ptr)->restart(path);
+        };
+
+        vtable.getCodecInfo = &ffmpeg::Recorder::getCodecInfo;
+
+        vtable.selectCodec = +[](const ffmpeg::RenderSettings& settings, size_t size) -> Result<std::string> {
+            return ffmpeg::Recorder::selectCodec(copySettings(settings, size));
+        };
+
         return ListenerResult::Stop;
     }).leak();
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "file_writer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+extern "C" {
+    #include <libavformat/avio.h>
+    #include <libavutil/error.h>
+    #include <libavutil/mem.h>
+}
+
+namespace ffmpeg::io {
+
+FileWriter::FileWriter(std::atomic<uint64_t>& queuedBytes, std::atomic<uint64_t>& stalls)
+    : m_queuedBytes(queuedBytes), m_stalls(stalls) {}
+
+FileWriter::~FileWriter() {
+    (void) close();
+}
+
+geode::Result<> FileWriter::open(const std::filesystem::path& path, LatencyCallback onWrite) {
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file)
+        return geode::Err("Could not open output file.");
+
+    // the context's own buffer is what makes a block, write_packet is only called once it is full
+    uint8_t* buffer = static_cast<uint8_t*>(av_malloc(BLOCK_SIZE));
+    if (!buffer)
+        return geode::Err("Could not allocate output buffer.");
+
+    m_context = avio_alloc_context(buffer, BLOCK_SIZE, 1, this, nullptr, &FileWriter::writePacket, &FileWriter::seek);
+    if (!m_context) {
+        av_free(buffer);
+        return geode::Err("Could not allocate output context.");
+    }
+
+    m_onWrite = std::move(onWrite);
+    m_position = 0;
+    m_size = 0;
+    m_stopRequested = false;
+    m_error.clear();
+    m_thread = std::thread(&FileWriter::writeLoop, this);
+
+    return geode::Ok();
+}
+
+geode::Result<> FileWriter::close() {
+    if (m_context)
+        avio_flush(m_context);
+
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopRequested = true;
+        }
+        m_blockCondition.notify_one();
+        m_thread.join();
+    }
+
+    if (m_context) {
+        av_freep(&m_context->buffer);
+        avio_context_free(&m_context);
+    }
+
+    if (m_file.is_open())
+        m_file.close();
+
+    m_blocks.clear();
+    m_freeBuffers.clear();
+    m_queuedBytes = 0;
+
+    if (!m_error.empty())
+        return geode::Err(m_error);
+    return geode::Ok();
+}
+
+int FileWriter::writePacket(void* opaque, const uint8_t* data, int size) {
+    auto self = static_cast<FileWriter*>(opaque);
+
+    Block block;
+    block.m_offset = self->m_position;
+    {
+        std::unique_lock lock(self->m_mutex);
+        if (self->m_blocks.size() >= MAX_QUEUED_BLOCKS) {
+            self->m_stalls++;
+            self->m_spaceCondition.wait(lock, [self] {
+                return self->m_blocks.size() < MAX_QUEUED_BLOCKS || !self->m_error.empty();
+            });
+        }
+
+        if (!self->m_error.empty())
+            return AVERROR(EIO);
+
+        if (!self->m_freeBuffers.empty()) {
+            block.m_data = std::move(self->m_freeBuffers.back());
+            self->m_freeBuffers.pop_back();
+        }
+    }
+
+    // copied outside the lock, the context reuses its buffer as soon as this returns
+    block.m_data.assign(data, data + size);
+
+    self->m_position += size;
+    self->m_size = std::max(self->m_size, self->m_position);
+    self->m_queuedBytes += size;
+
+    {
+        std::lock_guard lock(self->m_mutex);
+        self->m_blocks.push_back(std::move(block));
+    }
+    self->m_blockCondition.notify_one();
+
+    return size;
+}
+
+int64_t FileWriter::seek(void* opaque, int64_t offset, int whence) {
+    auto self = static_cast<FileWriter*>(opaque);
+
+    // the position is only tracked here, every block remembers where it has to be written
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE: return self->m_size;
+        case SEEK_SET: self->m_position = offset; break;
+        case SEEK_CUR: self->m_position += offset; break;
+        case SEEK_END: self->m_position = self->m_size + offset; break;
+        default: return AVERROR(EINVAL);
+    }
+
+    return self->m_position;
+}
+
+void FileWriter::writeLoop() {
+    int64_t filePosition = 0;
+
+    while (true) {
+        Block block;
+        {
+            std::unique_lock lock(m_mutex);
+            m_blockCondition.wait(lock, [this] { return !m_blocks.empty() || m_stopRequested; });
+
+            if (m_blocks.empty())
+                break;
+
+            block = std::move(m_blocks.front());
+            m_blocks.pop_front();
+        }
+        m_spaceCondition.notify_one();
+
+        auto start = std::chrono::steady_clock::now();
+
+        if (block.m_offset != filePosition)
+            m_file.seekp(block.m_offset);
+        m_file.write(reinterpret_cast<const char*>(block.m_data.data()), block.m_data.size());
+        filePosition = block.m_offset + static_cast<int64_t>(block.m_data.size());
+
+        if (m_onWrite)
+            m_onWrite(std::chrono::steady_clock::now() - start);
+
+        m_queuedBytes -= block.m_data.size();
+
+        std::lock_guard lock(m_mutex);
+        if (!m_file && m_error.empty()) {
+            m_error = "Could not write to output file.";
+            m_spaceCondition.notify_all();
+        }
+
+        m_freeBuffers.push_back(std::move(block.m_data));
+    }
+
+    m_file.flush();
+    if (!m_file && m_error.empty())
+        m_error = "Could not write to output file.";
+}
+
+}
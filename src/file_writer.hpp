@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Geode/Result.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AVIOContext;
+
+namespace ffmpeg::io {
+
+/**
+ * Muxer output that collects writes into large blocks and writes them to disk on a
+ * dedicated thread. Slow storage only stalls encoding once the bounded queue is full.
+ * Seeks are queued in order with the writes, so the muxer can still patch headers.
+ */
+class FileWriter {
+public:
+    static constexpr size_t BLOCK_SIZE = 4 * 1024 * 1024;
+    static constexpr size_t MAX_QUEUED_BLOCKS = 16;
+
+    // called on the writer thread after every block with the time the write took
+    using LatencyCallback = std::function<void(std::chrono::nanoseconds)>;
+
+    // the queue depth and stall counters live with the owner, so they can be read after the writer is gone
+    FileWriter(std::atomic<uint64_t>& queuedBytes, std::atomic<uint64_t>& stalls);
+    ~FileWriter();
+
+    geode::Result<> open(const std::filesystem::path& path, LatencyCallback onWrite);
+    // flushes the context and waits until everything queued is on disk
+    geode::Result<> close();
+
+    AVIOContext* getContext() const { return m_context; }
+
+private:
+    struct Block {
+        int64_t m_offset = 0;
+        std::vector<uint8_t> m_data;
+    };
+
+    static int writePacket(void* opaque, const uint8_t* data, int size);
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+    void writeLoop();
+
+    AVIOContext* m_context = nullptr;
+    std::ofstream m_file;
+    LatencyCallback m_onWrite;
+
+    // only touched by the muxing thread
+    int64_t m_position = 0;
+    int64_t m_size = 0;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_blockCondition;
+    std::condition_variable m_spaceCondition;
+    std::deque<Block> m_blocks;
+    std::vector<std::vector<uint8_t>> m_freeBuffers;
+    std::string m_error;
+    bool m_stopRequested = false;
+
+    std::atomic<uint64_t>& m_queuedBytes;
+    std::atomic<uint64_t>& m_stalls;
+};
+
+}
@@ -0,0 +1,138 @@
+#include "frame_hash.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+    #include <libavutil/cpu.h>
+}
+
+namespace ffmpeg::hash {
+
+// every 32-byte block is split into four 64-bit lanes, each lane accumulates w + lo32(w ^ k) * hi32(w ^ k).
+// the keys advance by KEY_STEP per block, so the same block at another position adds something else and
+// content moved sideways within a row changes the hash
+constexpr uint64_t KEYS[4] = { 0x9E3779B185EBCA87ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull };
+constexpr uint64_t KEY_STEP = 0xD6E8FEB86659FD93ull;
+constexpr uint64_t PRIME = 0x9E3779B97F4A7C15ull;
+
+static inline uint64_t accumulate(uint64_t acc, uint64_t word, uint64_t key) {
+    uint64_t mixed = word ^ key;
+    return acc + word + (mixed & 0xFFFFFFFF) * (mixed >> 32);
+}
+
+// mixes the lanes into the running hash and handles the bytes after the last full block
+static uint64_t finishRow(const uint64_t lanes[4], const uint8_t* tail, size_t tailSize, uint64_t hash) {
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ lanes[i]) * PRIME;
+        hash ^= hash >> 29;
+    }
+
+    for (size_t i = 0; i < tailSize; i++)
+        hash = (hash ^ tail[i]) * PRIME;
+
+    return hash;
+}
+
+static uint64_t rowHashC(const uint8_t* row, size_t size, uint64_t hash) {
+    uint64_t lanes[4] = {};
+    uint64_t keys[4] = { KEYS[0], KEYS[1], KEYS[2], KEYS[3] };
+    size_t x = 0;
+    for (; x + 32 <= size; x += 32) {
+        for (int i = 0; i < 4; i++) {
+            uint64_t word;
+            std::memcpy(&word, row + x + i * 8, 8);
+            lanes[i] = accumulate(lanes[i], word, keys[i]);
+            keys[i] += KEY_STEP;
+        }
+    }
+
+    return finishRow(lanes, row + x, size - x, hash);
+}
+
+#ifdef FFMPEG_API_X86
+
+FFMPEG_API_TARGET("avx2")
+static uint64_t rowHashAVX2(const uint8_t* row, size_t size, uint64_t hash) {
+    const __m256i step = _mm256_set1_epi64x(static_cast<int64_t>(KEY_STEP));
+    __m256i keys = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(KEYS));
+    __m256i acc = _mm256_setzero_si256();
+
+    size_t x = 0;
+    for (; x + 32 <= size; x += 32) {
+        __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+        __m256i mixed = _mm256_xor_si256(words, keys);
+        __m256i product = _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32));
+        acc = _mm256_add_epi64(acc, _mm256_add_epi64(words, product));
+        keys = _mm256_add_epi64(keys, step);
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    return finishRow(lanes, row + x, size - x, hash);
+}
+
+#endif
+
+#ifdef FFMPEG_API_NEON
+
+static uint64_t rowHashNEON(const uint8_t* row, size_t size, uint64_t hash) {
+    const uint64x2_t step = vdupq_n_u64(KEY_STEP);
+    uint64x2_t keys0 = vld1q_u64(KEYS);
+    uint64x2_t keys1 = vld1q_u64(KEYS + 2);
+    uint64x2_t acc0 = vdupq_n_u64(0);
+    uint64x2_t acc1 = vdupq_n_u64(0);
+
+    size_t x = 0;
+    for (; x + 32 <= size; x += 32) {
+        uint64x2_t words0 = vreinterpretq_u64_u8(vld1q_u8(row + x));
+        uint64x2_t words1 = vreinterpretq_u64_u8(vld1q_u8(row + x + 16));
+        uint64x2_t mixed0 = veorq_u64(words0, keys0);
+        uint64x2_t mixed1 = veorq_u64(words1, keys1);
+        acc0 = vaddq_u64(acc0, vaddq_u64(words0, vmull_u32(vmovn_u64(mixed0), vshrn_n_u64(mixed0, 32))));
+        acc1 = vaddq_u64(acc1, vaddq_u64(words1, vmull_u32(vmovn_u64(mixed1), vshrn_n_u64(mixed1, 32))));
+        keys0 = vaddq_u64(keys0, step);
+        keys1 = vaddq_u64(keys1, step);
+    }
+
+    uint64_t lanes[4];
+    vst1q_u64(lanes, acc0);
+    vst1q_u64(lanes + 2, acc1);
+    return finishRow(lanes, row + x, size - x, hash);
+}
+
+#endif
+
+uint64_t FrameHasher::hash(const uint8_t* data, size_t size, size_t rowSize) const {
+    uint64_t hash = size;
+    for (size_t offset = 0; offset < size; offset += rowSize * ROW_STEP)
+        hash = m_rowHash(data + offset, std::min(rowSize, size - offset), hash);
+    return hash;
+}
+
+FrameHasher getFrameHasher() {
+    FrameHasher hasher;
+    hasher.m_rowHash = &rowHashC;
+    hasher.m_name = "c";
+
+    [[maybe_unused]] int flags = av_get_cpu_flags();
+
+#ifdef FFMPEG_API_X86
+    if (flags & AV_CPU_FLAG_AVX2) {
+        hasher.m_rowHash = &rowHashAVX2;
+        hasher.m_name = "avx2";
+    }
+#endif
+
+#ifdef FFMPEG_API_NEON
+    if (flags & AV_CPU_FLAG_NEON) {
+        hasher.m_rowHash = &rowHashNEON;
+        hasher.m_name = "neon";
+    }
+#endif
+
+    return hasher;
+}
+
+}
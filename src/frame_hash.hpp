@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ffmpeg::hash {
+
+// folds one row into the running hash
+using RowHashFunc = uint64_t(*)(const uint8_t* row, size_t size, uint64_t hash);
+
+/**
+ * Fast fingerprint of a frame, used to detect consecutive identical frames.
+ * Only every ROW_STEP-th row is read, so a change confined to the skipped rows goes unnoticed.
+ * Every kernel produces the same hash.
+ */
+struct FrameHasher {
+    static constexpr size_t ROW_STEP = 2;
+
+    RowHashFunc m_rowHash = nullptr;
+    const char* m_name = "";
+
+    uint64_t hash(const uint8_t* data, size_t size, size_t rowSize) const;
+};
+
+// picks the fastest kernel for this CPU
+FrameHasher getFrameHasher();
+
+}
@@ -0,0 +1,424 @@
+#include "pixel_convert.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+    #include <libavutil/cpu.h>
+    #include <libswscale/swscale.h>
+}
+
+namespace ffmpeg::convert {
+
+// Y = (ky . rgb + Y_OFFSET) >> 15, U/V = (kuv . sum of 2x2 block + UV_OFFSET) >> 17
+constexpr int32_t Y_OFFSET = (16 << 15) + (1 << 14);
+constexpr int32_t UV_OFFSET = (128 << 17) + (1 << 16);
+
+static uint8_t clampByte(int32_t value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+static uint8_t lumaScalar(const uint8_t* px, const Coefficients& k) {
+    return clampByte((px[0] * k.y[0] + px[1] * k.y[1] + px[2] * k.y[2] + px[3] * k.y[3] + Y_OFFSET) >> 15);
+}
+
+static void rowPairScalar(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int start, int width, const Coefficients& k, bool interleaved) {
+    for (int x = start; x < width; x += 2) {
+        const uint8_t* a = src0 + x * 4;
+        const uint8_t* b = src1 + x * 4;
+
+        y0[x] = lumaScalar(a, k);
+        y0[x + 1] = lumaScalar(a + 4, k);
+        y1[x] = lumaScalar(b, k);
+        y1[x + 1] = lumaScalar(b + 4, k);
+
+        int32_t uSum = UV_OFFSET;
+        int32_t vSum = UV_OFFSET;
+        for (int c = 0; c < 4; c++) {
+            int32_t sum = a[c] + a[c + 4] + b[c] + b[c + 4];
+            uSum += sum * k.u[c];
+            vSum += sum * k.v[c];
+        }
+
+        if (interleaved) {
+            u[x] = clampByte(uSum >> 17);
+            u[x + 1] = clampByte(vSum >> 17);
+        } else {
+            u[x / 2] = clampByte(uSum >> 17);
+            v[x / 2] = clampByte(vSum >> 17);
+        }
+    }
+}
+
+template <bool Interleaved>
+static void rowPairC(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width, const Coefficients& k) {
+    rowPairScalar(src0, src1, y0, y1, u, v, 0, width, k, Interleaved);
+}
+
+#ifdef FFMPEG_API_X86
+
+// 4 pixels -> 4 luma values as int32
+FFMPEG_API_TARGET("sse4.1")
+static inline __m128i luma4SSE(__m128i px, __m128i k, __m128i offset) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), k);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), k);
+    return _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), offset), 15);
+}
+
+// 4 pixels of two rows -> per channel sums of the two 2x2 blocks as int16
+FFMPEG_API_TARGET("sse4.1")
+static inline __m128i sum2x2SSE(__m128i a, __m128i b) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    return _mm_unpacklo_epi64(lo, hi);
+}
+
+// two sets of block sums -> 4 chroma values as int32
+FFMPEG_API_TARGET("sse4.1")
+static inline __m128i chroma4SSE(__m128i s0, __m128i s1, __m128i k, __m128i offset) {
+    __m128i sum = _mm_hadd_epi32(_mm_madd_epi16(s0, k), _mm_madd_epi16(s1, k));
+    return _mm_srai_epi32(_mm_add_epi32(sum, offset), 17);
+}
+
+template <bool Interleaved>
+FFMPEG_API_TARGET("sse4.1")
+static void rowPairSSE41(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width, const Coefficients& k) {
+    const __m128i ky = _mm_setr_epi16(k.y[0], k.y[1], k.y[2], k.y[3], k.y[0], k.y[1], k.y[2], k.y[3]);
+    const __m128i ku = _mm_setr_epi16(k.u[0], k.u[1], k.u[2], k.u[3], k.u[0], k.u[1], k.u[2], k.u[3]);
+    const __m128i kv = _mm_setr_epi16(k.v[0], k.v[1], k.v[2], k.v[3], k.v[0], k.v[1], k.v[2], k.v[3]);
+    const __m128i yOffset = _mm_set1_epi32(Y_OFFSET);
+    const __m128i uvOffset = _mm_set1_epi32(UV_OFFSET);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i a[4], b[4];
+        for (int i = 0; i < 4; i++) {
+            a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + (x + i * 4) * 4));
+            b[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + (x + i * 4) * 4));
+        }
+
+        __m128i luma0 = _mm_packus_epi16(
+            _mm_packs_epi32(luma4SSE(a[0], ky, yOffset), luma4SSE(a[1], ky, yOffset)),
+            _mm_packs_epi32(luma4SSE(a[2], ky, yOffset), luma4SSE(a[3], ky, yOffset)));
+        __m128i luma1 = _mm_packus_epi16(
+            _mm_packs_epi32(luma4SSE(b[0], ky, yOffset), luma4SSE(b[1], ky, yOffset)),
+            _mm_packs_epi32(luma4SSE(b[2], ky, yOffset), luma4SSE(b[3], ky, yOffset)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), luma0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), luma1);
+
+        __m128i s[4];
+        for (int i = 0; i < 4; i++)
+            s[i] = sum2x2SSE(a[i], b[i]);
+
+        __m128i cb = _mm_packs_epi32(chroma4SSE(s[0], s[1], ku, uvOffset), chroma4SSE(s[2], s[3], ku, uvOffset));
+        __m128i cr = _mm_packs_epi32(chroma4SSE(s[0], s[1], kv, uvOffset), chroma4SSE(s[2], s[3], kv, uvOffset));
+        cb = _mm_packus_epi16(cb, cb);
+        cr = _mm_packus_epi16(cr, cr);
+
+        if constexpr (Interleaved) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_unpacklo_epi8(cb, cr));
+        } else {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), cb);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), cr);
+        }
+    }
+
+    rowPairScalar(src0, src1, y0, y1, u, v, x, width, k, Interleaved);
+}
+
+// 8 pixels -> 8 luma values as int32, in order
+FFMPEG_API_TARGET("avx2")
+static inline __m256i luma8AVX2(__m256i px, __m256i k, __m256i offset) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), k);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), k);
+    return _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), offset), 15);
+}
+
+// 16 int32 -> 16 bytes, in order
+FFMPEG_API_TARGET("avx2")
+static inline __m128i packBytesAVX2(__m256i a, __m256i b) {
+    __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+    return _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+}
+
+FFMPEG_API_TARGET("avx2")
+static inline __m256i sum2x2AVX2(__m256i a, __m256i b) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+    __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+    lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+    hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+    return _mm256_unpacklo_epi64(lo, hi);
+}
+
+// block sums of 16 pixels -> 8 chroma values as int32, in order
+FFMPEG_API_TARGET("avx2")
+static inline __m256i chroma8AVX2(__m256i s0, __m256i s1, __m256i k, __m256i offset) {
+    __m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(s0, k), _mm256_madd_epi16(s1, k));
+    sum = _mm256_permute4x64_epi64(sum, 0xD8);
+    return _mm256_srai_epi32(_mm256_add_epi32(sum, offset), 17);
+}
+
+template <bool Interleaved>
+FFMPEG_API_TARGET("avx2")
+static void rowPairAVX2(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width, const Coefficients& k) {
+    const __m256i ky = _mm256_setr_epi16(
+        k.y[0], k.y[1], k.y[2], k.y[3], k.y[0], k.y[1], k.y[2], k.y[3],
+        k.y[0], k.y[1], k.y[2], k.y[3], k.y[0], k.y[1], k.y[2], k.y[3]);
+    const __m256i ku = _mm256_setr_epi16(
+        k.u[0], k.u[1], k.u[2], k.u[3], k.u[0], k.u[1], k.u[2], k.u[3],
+        k.u[0], k.u[1], k.u[2], k.u[3], k.u[0], k.u[1], k.u[2], k.u[3]);
+    const __m256i kv = _mm256_setr_epi16(
+        k.v[0], k.v[1], k.v[2], k.v[3], k.v[0], k.v[1], k.v[2], k.v[3],
+        k.v[0], k.v[1], k.v[2], k.v[3], k.v[0], k.v[1], k.v[2], k.v[3]);
+    const __m256i yOffset = _mm256_set1_epi32(Y_OFFSET);
+    const __m256i uvOffset = _mm256_set1_epi32(UV_OFFSET);
+
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i a[4], b[4];
+        for (int i = 0; i < 4; i++) {
+            a[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src0 + (x + i * 8) * 4));
+            b[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src1 + (x + i * 8) * 4));
+        }
+
+        __m256i luma0 = _mm256_set_m128i(
+            packBytesAVX2(luma8AVX2(a[2], ky, yOffset), luma8AVX2(a[3], ky, yOffset)),
+            packBytesAVX2(luma8AVX2(a[0], ky, yOffset), luma8AVX2(a[1], ky, yOffset)));
+        __m256i luma1 = _mm256_set_m128i(
+            packBytesAVX2(luma8AVX2(b[2], ky, yOffset), luma8AVX2(b[3], ky, yOffset)),
+            packBytesAVX2(luma8AVX2(b[0], ky, yOffset), luma8AVX2(b[1], ky, yOffset)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + x), luma0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + x), luma1);
+
+        __m256i s[4];
+        for (int i = 0; i < 4; i++)
+            s[i] = sum2x2AVX2(a[i], b[i]);
+
+        __m128i cb = packBytesAVX2(chroma8AVX2(s[0], s[1], ku, uvOffset), chroma8AVX2(s[2], s[3], ku, uvOffset));
+        __m128i cr = packBytesAVX2(chroma8AVX2(s[0], s[1], kv, uvOffset), chroma8AVX2(s[2], s[3], kv, uvOffset));
+
+        if constexpr (Interleaved) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_unpacklo_epi8(cb, cr));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x + 16), _mm_unpackhi_epi8(cb, cr));
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2), cb);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2), cr);
+        }
+    }
+
+    rowPairScalar(src0, src1, y0, y1, u, v, x, width, k, Interleaved);
+}
+
+#endif
+
+#ifdef FFMPEG_API_NEON
+
+// 4 pixels worth of channels -> 4 luma values
+static inline uint16x4_t luma4NEON(int16x4_t c0, int16x4_t c1, int16x4_t c2, int16x4_t c3, const Coefficients& k) {
+    int32x4_t acc = vdupq_n_s32(Y_OFFSET);
+    acc = vmlal_n_s16(acc, c0, k.y[0]);
+    acc = vmlal_n_s16(acc, c1, k.y[1]);
+    acc = vmlal_n_s16(acc, c2, k.y[2]);
+    acc = vmlal_n_s16(acc, c3, k.y[3]);
+    return vqmovun_s32(vshrq_n_s32(acc, 15));
+}
+
+static inline uint8x8_t luma8NEON(const int16x8_t c[4], const Coefficients& k) {
+    uint16x4_t lo = luma4NEON(vget_low_s16(c[0]), vget_low_s16(c[1]), vget_low_s16(c[2]), vget_low_s16(c[3]), k);
+    uint16x4_t hi = luma4NEON(vget_high_s16(c[0]), vget_high_s16(c[1]), vget_high_s16(c[2]), vget_high_s16(c[3]), k);
+    return vqmovn_u16(vcombine_u16(lo, hi));
+}
+
+static inline uint16x4_t chroma4NEON(int16x4_t s0, int16x4_t s1, int16x4_t s2, int16x4_t s3, const int16_t* k) {
+    int32x4_t acc = vdupq_n_s32(UV_OFFSET);
+    acc = vmlal_n_s16(acc, s0, k[0]);
+    acc = vmlal_n_s16(acc, s1, k[1]);
+    acc = vmlal_n_s16(acc, s2, k[2]);
+    acc = vmlal_n_s16(acc, s3, k[3]);
+    return vqmovun_s32(vshrq_n_s32(acc, 17));
+}
+
+static inline uint8x8_t chroma8NEON(const int16x8_t s[4], const int16_t* k) {
+    uint16x4_t lo = chroma4NEON(vget_low_s16(s[0]), vget_low_s16(s[1]), vget_low_s16(s[2]), vget_low_s16(s[3]), k);
+    uint16x4_t hi = chroma4NEON(vget_high_s16(s[0]), vget_high_s16(s[1]), vget_high_s16(s[2]), vget_high_s16(s[3]), k);
+    return vqmovn_u16(vcombine_u16(lo, hi));
+}
+
+template <bool Interleaved>
+static void rowPairNEON(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width, const Coefficients& k) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        // deinterleaves 16 pixels into one register per channel
+        uint8x16x4_t a = vld4q_u8(src0 + x * 4);
+        uint8x16x4_t b = vld4q_u8(src1 + x * 4);
+
+        int16x8_t aLo[4], aHi[4], bLo[4], bHi[4], s[4];
+        for (int c = 0; c < 4; c++) {
+            aLo[c] = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(a.val[c])));
+            aHi[c] = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(a.val[c])));
+            bLo[c] = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(b.val[c])));
+            bHi[c] = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(b.val[c])));
+            // horizontal pairs of both rows
+            s[c] = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(a.val[c]), b.val[c]));
+        }
+
+        vst1q_u8(y0 + x, vcombine_u8(luma8NEON(aLo, k), luma8NEON(aHi, k)));
+        vst1q_u8(y1 + x, vcombine_u8(luma8NEON(bLo, k), luma8NEON(bHi, k)));
+
+        uint8x8_t cb = chroma8NEON(s, k.u);
+        uint8x8_t cr = chroma8NEON(s, k.v);
+
+        if constexpr (Interleaved) {
+            vst2_u8(u + x, uint8x8x2_t{{cb, cr}});
+        } else {
+            vst1_u8(u + x / 2, cb);
+            vst1_u8(v + x / 2, cr);
+        }
+    }
+
+    rowPairScalar(src0, src1, y0, y1, u, v, x, width, k, Interleaved);
+}
+
+#endif
+
+void FastConverter::convert(const uint8_t* src, ptrdiff_t srcStride, uint8_t* const dst[4], const int dstStride[4], int width, int height) const {
+    for (int y = 0; y < height; y += 2) {
+        const uint8_t* src0 = src + srcStride * y;
+        uint8_t* y0 = dst[0] + static_cast<ptrdiff_t>(dstStride[0]) * y;
+        uint8_t* u = dst[1] + static_cast<ptrdiff_t>(dstStride[1]) * (y / 2);
+        uint8_t* v = m_interleaved ? nullptr : dst[2] + static_cast<ptrdiff_t>(dstStride[2]) * (y / 2);
+
+        m_rowPair(src0, src0 + srcStride, y0, y0 + dstStride[0], u, v, width, m_coeffs);
+    }
+}
+
+// byte offsets of the red, green and blue channels, false if the format isn't packed 32-bit RGB
+static bool getChannelOffsets(AVPixelFormat format, int& r, int& g, int& b) {
+    switch (format) {
+        case AV_PIX_FMT_RGBA: case AV_PIX_FMT_RGB0: r = 0; g = 1; b = 2; return true;
+        case AV_PIX_FMT_BGRA: case AV_PIX_FMT_BGR0: r = 2; g = 1; b = 0; return true;
+        case AV_PIX_FMT_ARGB: case AV_PIX_FMT_0RGB: r = 1; g = 2; b = 3; return true;
+        case AV_PIX_FMT_ABGR: case AV_PIX_FMT_0BGR: r = 3; g = 2; b = 1; return true;
+        default: return false;
+    }
+}
+
+static Coefficients getCoefficients(int r, int g, int b) {
+    // BT.709 with Kr = 0.2126, Kb = 0.0722, scaled to limited range and 15 fractional bits
+    Coefficients k{};
+    k.y[r] = 5983;   k.y[g] = 20127;  k.y[b] = 2032;
+    k.u[r] = -3298;  k.u[g] = -11094; k.u[b] = 14392;
+    k.v[r] = 14392;  k.v[g] = -13074; k.v[b] = -1318;
+    return k;
+}
+
+std::optional<FastConverter> getFastConverter(AVPixelFormat srcFormat, AVPixelFormat dstFormat, int width, int height) {
+    int r, g, b;
+    if (!getChannelOffsets(srcFormat, r, g, b))
+        return std::nullopt;
+
+    if (dstFormat != AV_PIX_FMT_YUV420P && dstFormat != AV_PIX_FMT_NV12)
+        return std::nullopt;
+
+    if (width <= 0 || height <= 0 || width % 2 || height % 2)
+        return std::nullopt;
+
+    FastConverter converter;
+    converter.m_coeffs = getCoefficients(r, g, b);
+    converter.m_interleaved = dstFormat == AV_PIX_FMT_NV12;
+    converter.m_rowPair = converter.m_interleaved ? &rowPairC<true> : &rowPairC<false>;
+    converter.m_name = "c";
+
+    [[maybe_unused]] int flags = av_get_cpu_flags();
+
+#ifdef FFMPEG_API_X86
+    if (flags & AV_CPU_FLAG_AVX2) {
+        converter.m_rowPair = converter.m_interleaved ? &rowPairAVX2<true> : &rowPairAVX2<false>;
+        converter.m_name = "avx2";
+    } else if (flags & AV_CPU_FLAG_SSE4) {
+        converter.m_rowPair = converter.m_interleaved ? &rowPairSSE41<true> : &rowPairSSE41<false>;
+        converter.m_name = "sse4.1";
+    }
+#endif
+
+#ifdef FFMPEG_API_NEON
+    if (flags & AV_CPU_FLAG_NEON) {
+        converter.m_rowPair = converter.m_interleaved ? &rowPairNEON<true> : &rowPairNEON<false>;
+        converter.m_name = "neon";
+    }
+#endif
+
+    return converter;
+}
+
+bool verifyFastConverter(const FastConverter& converter, AVPixelFormat srcFormat, AVPixelFormat dstFormat) {
+    // wide enough to cover both the vector loops and the scalar tail
+    constexpr int width = 72;
+    constexpr int height = 16;
+    constexpr int lumaTolerance = 2;
+    constexpr int chromaTolerance = 4;
+
+    std::vector<uint8_t> src(width * height * 4);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* px = &src[(y * width + x) * 4];
+            px[0] = static_cast<uint8_t>(x * 255 / (width - 1));
+            px[1] = static_cast<uint8_t>(y * 255 / (height - 1));
+            px[2] = static_cast<uint8_t>((x + y) * 255 / (width + height - 2));
+            px[3] = static_cast<uint8_t>(255 - x * 2);
+        }
+    }
+
+    int chromaWidth = converter.m_interleaved ? width : width / 2;
+    std::vector<uint8_t> fast(width * height * 3 / 2);
+    std::vector<uint8_t> reference(fast.size());
+
+    auto planes = [&](std::vector<uint8_t>& buffer, uint8_t* data[4], int stride[4]) {
+        data[0] = buffer.data();
+        data[1] = data[0] + width * height;
+        data[2] = converter.m_interleaved ? nullptr : data[1] + chromaWidth * height / 2;
+        data[3] = nullptr;
+        stride[0] = width;
+        stride[1] = chromaWidth;
+        stride[2] = converter.m_interleaved ? 0 : chromaWidth;
+        stride[3] = 0;
+    };
+
+    uint8_t* fastData[4];
+    int fastStride[4];
+    planes(fast, fastData, fastStride);
+    converter.convert(src.data(), width * 4, fastData, fastStride, width, height);
+
+    SwsContext* sws = sws_getContext(width, height, srcFormat, width, height, dstFormat, SWS_BILINEAR | SWS_ACCURATE_RND, nullptr, nullptr, nullptr);
+    if (!sws)
+        return false;
+
+    const int* bt709 = sws_getCoefficients(SWS_CS_ITU709);
+    sws_setColorspaceDetails(sws, bt709, 1, bt709, 0, 0, 1 << 16, 1 << 16);
+
+    uint8_t* refData[4];
+    int refStride[4];
+    planes(reference, refData, refStride);
+    const uint8_t* srcData[4] = { src.data(), nullptr, nullptr, nullptr };
+    const int srcStride[4] = { width * 4, 0, 0, 0 };
+    sws_scale(sws, srcData, srcStride, 0, height, refData, refStride);
+    sws_freeContext(sws);
+
+    for (size_t i = 0; i < fast.size(); i++) {
+        int tolerance = i < static_cast<size_t>(width * height) ? lumaTolerance : chromaTolerance;
+        if (std::abs(fast[i] - reference[i]) > tolerance)
+            return false;
+    }
+
+    return true;
+}
+
+}
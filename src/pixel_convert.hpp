@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+extern "C" {
+    #include <libavutil/pixfmt.h>
+}
+
+namespace ffmpeg::convert {
+
+// fixed point BT.709 limited range coefficients, ordered by byte position within a pixel
+struct Coefficients {
+    int16_t y[4];
+    int16_t u[4];
+    int16_t v[4];
+};
+
+// converts two rows of packed 32-bit RGB into two luma rows and one chroma row
+using RowPairFunc = void(*)(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width, const Coefficients& coeffs);
+
+/**
+ * Hand-vectorized conversion from packed 32-bit RGB (RGB0, BGRA, ...) to
+ * 8-bit 4:2:0 BT.709 limited range YUV (yuv420p or nv12).
+ * A negative source stride reads the image bottom-up, flipping it in the same pass.
+ */
+struct FastConverter {
+    RowPairFunc m_rowPair = nullptr;
+    Coefficients m_coeffs{};
+    bool m_interleaved = false;
+    const char* m_name = "";
+
+    void convert(const uint8_t* src, ptrdiff_t srcStride, uint8_t* const dst[4], const int dstStride[4], int width, int height) const;
+};
+
+// picks the fastest kernel for this CPU, or nothing if the format pair or size isn't supported
+std::optional<FastConverter> getFastConverter(AVPixelFormat srcFormat, AVPixelFormat dstFormat, int width, int height);
+
+// compares the kernel against swscale on a synthetic image
+bool verifyFastConverter(const FastConverter& converter, AVPixelFormat srcFormat, AVPixelFormat dstFormat);
+
+}
@@ -1,32 +1,218 @@
 #include "recorder.hpp"
 #include "utils.hpp"
+#include "pixel_convert.hpp"
+#include "encoder_profiles.hpp"
+#include "frame_hash.hpp"
+#include "file_writer.hpp"
+#include "callback_writer.hpp"
+#include "replay_buffer.hpp"
+#include "chunk_encoder.hpp"
+#include "codec_registry.hpp"
 
 extern "C" {
     #include <libavcodec/avcodec.h>
     #include <libavformat/avformat.h>
+    #include <libavutil/audio_fifo.h>
     #include <libavutil/imgutils.h>
+    #include <libavutil/pixdesc.h>
+    #include <libavutil/opt.h>
     #include <libswscale/swscale.h>
+    #include <libswresample/swresample.h>
     #include <libavfilter/avfilter.h>
     #include <libavfilter/buffersrc.h>
     #include <libavfilter/buffersink.h>
 }
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
 BEGIN_FFMPEG_NAMESPACE_V
 
-std::vector<std::string> Recorder::getAvailableCodecs() {
-    std::vector<std::string> vec;
+constexpr size_t FRAME_ALIGNMENT = 64;
+// audio timestamps that are off by less than this are treated as continuous
+constexpr int AUDIO_RESYNC_MILLIS = 20;
+// gaps in the audio are filled with this many samples of silence at a time
+constexpr int AUDIO_SILENCE_CHUNK = 4096;
+// the automatically selected encoder has to encode this much faster than realtime
+constexpr double AUTO_CODEC_HEADROOM = 1.5;
+// length of the benchmark clip, at most one second
+constexpr int AUTO_CODEC_CLIP_FRAMES = 60;
+// rows the benchmark clip scrolls per frame, even so chroma rows stay aligned
+constexpr int AUTO_CODEC_SCROLL = 4;
+// default chunk encoders for hardware encoders, consumer GPUs only allow a few sessions at once
+constexpr size_t HARDWARE_CHUNK_ENCODERS = 2;
+
+static uint8_t* alignFrameData(uint8_t* data) {
+    return reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(data) + FRAME_ALIGNMENT - 1) & ~(FRAME_ALIGNMENT - 1));
+}
 
-    void* iter = nullptr;
-    const AVCodec * codec;
+static int getConversionThreads(const RenderSettings& settings) {
+    if (settings.m_conversionThreads > 0)
+        return static_cast<int>(settings.m_conversionThreads);
 
-    while ((codec = av_codec_iterate(&iter))) {
-        if(codec->type == AVMEDIA_TYPE_VIDEO &&
-                (codec->id == AV_CODEC_ID_H264 || codec->id == AV_CODEC_ID_HEVC || codec->id == AV_CODEC_ID_VP8 || codec->id == AV_CODEC_ID_VP9 || codec->id == AV_CODEC_ID_AV1 || codec->id == AV_CODEC_ID_MPEG4) &&
-                avcodec_find_encoder_by_name(codec->name) != nullptr && codec->pix_fmts && std::ranges::find(vec, std::string(codec->name)) == vec.end())
-            vec.emplace_back(codec->name);
+    // below 1080p a single thread keeps up and thread wakeups would cost more than they save
+    if (settings.m_height < 1080)
+        return 1;
+
+    unsigned int cores = std::thread::hardware_concurrency();
+    return static_cast<int>(std::clamp(cores / 2, 1u, settings.m_height >= 1440 ? 8u : 4u));
+}
+
+using Clock = std::chrono::steady_clock;
+
+static bool isFragmentableFormat(const AVOutputFormat* format) {
+    std::string_view name = format->name;
+    return name == "mp4" || name == "mov" || name == "ipod" || name == "ismv";
+}
+
+// "recording.mp4" -> "recording_000.mp4"
+static std::filesystem::path getSegmentPath(const std::filesystem::path& path, uint32_t index) {
+    std::string number = std::to_string(index);
+    if (number.size() < 3)
+        number.insert(0, 3 - number.size(), '0');
+
+    std::filesystem::path name = path.stem();
+    name += "_" + number;
+    name += path.extension();
+    return path.parent_path() / name;
+}
+
+// thread count and FF_THREAD_* type for the encoder, a count of 0 leaves the codec's default
+static std::pair<int, int> getEncoderThreading(const AVCodec* codec, const RenderSettings& settings) {
+    if (codec->capabilities & AV_CODEC_CAP_HARDWARE)
+        return {1, 0};
+
+    bool slice = codec->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+    bool frame = codec->capabilities & AV_CODEC_CAP_FRAME_THREADS;
+    bool external = codec->capabilities & AV_CODEC_CAP_OTHER_THREADS;
+    if (!slice && !frame && !external)
+        return {1, 0};
+
+    // codec libraries take the requested type as a hint, libx264 switches to sliced threads for FF_THREAD_SLICE
+    int type = 0;
+    if (settings.m_encoderThreadType == ThreadType::FRAME && (frame || external))
+        type = FF_THREAD_FRAME;
+    else if (settings.m_encoderThreadType == ThreadType::SLICE && (slice || external))
+        type = FF_THREAD_SLICE;
+    else if (external)
+        type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    else
+        type = slice ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+
+    if (settings.m_encoderThreads > 0)
+        return {static_cast<int>(settings.m_encoderThreads), type};
+
+    int cores = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    int available = std::max(cores - static_cast<int>(settings.m_reservedCores), 1);
+
+    // past roughly one thread per 64k pixels there is nothing left to split,
+    // vpx and aom split into tiles at least 256 (aom rows 128) pixels wide
+    std::string_view name = codec->name;
+    int useful = static_cast<int>(static_cast<int64_t>(settings.m_width) * settings.m_height / (256 * 256));
+    if (name.starts_with("libvpx"))
+        useful = static_cast<int>(settings.m_width / 256);
+    else if (name.starts_with("libaom"))
+        useful = static_cast<int>(settings.m_width / 128);
+
+    return {std::clamp(useful, 1, available), type};
+}
+
+// the threading an opened encoder actually uses, libavcodec only reports its own
+static ThreadType getActiveThreadType(const AVCodec* codec, const AVCodecContext* context) {
+    if (context->active_thread_type & FF_THREAD_FRAME)
+        return ThreadType::FRAME;
+    if (context->active_thread_type & FF_THREAD_SLICE)
+        return ThreadType::SLICE;
+    if (!(codec->capabilities & AV_CODEC_CAP_OTHER_THREADS) || context->thread_count == 1)
+        return ThreadType::NONE;
+
+    // libx264 uses sliced threads only when asked for exactly FF_THREAD_SLICE, frame threads otherwise.
+    // other libraries pick for themselves
+    if (std::string_view(codec->name) == "libx264")
+        return context->thread_type == FF_THREAD_SLICE ? ThreadType::SLICE : ThreadType::FRAME;
+    return ThreadType::CODEC;
+}
+
+// the input format if the encoder takes it as is, AV_PIX_FMT_NONE if it needs a conversion
+static AVPixelFormat getEncoderPixelFormat(const AVCodec* codec, AVPixelFormat input) {
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+    for (const AVPixelFormat* pix_fmt = codec->pix_fmts; pix_fmt && *pix_fmt != AV_PIX_FMT_NONE; ++pix_fmt) {
+        // secretly force pix fmt to nv12. seems to work contrary to yuv420p.
+        // with AV_PIX_FMT_MEDIACODEC mediacodec would go into surface mode and expect a surface
+        if (*pix_fmt == AV_PIX_FMT_MEDIACODEC)
+            return AV_PIX_FMT_NV12;
+        if (*pix_fmt == input)
+            format = *pix_fmt;
+    }
+    return format;
+}
+
+static bool isRgbToYuv(AVPixelFormat src, AVPixelFormat dst) {
+    const AVPixFmtDescriptor* srcDesc = av_pix_fmt_desc_get(src);
+    const AVPixFmtDescriptor* dstDesc = av_pix_fmt_desc_get(dst);
+    return srcDesc && dstDesc && (srcDesc->flags & AV_PIX_FMT_FLAG_RGB) && !(dstDesc->flags & AV_PIX_FMT_FLAG_RGB)
+        && dstDesc->nb_components >= 3;
+}
+
+// colorspace filters are written against swscale's default BT.601 output, so the BT.709 matrix is only used without them
+static bool usesBt709Matrix(const RenderSettings& settings, AVPixelFormat src, AVPixelFormat dst) {
+    return settings.m_colorspaceFilters.empty() && isRgbToYuv(src, dst);
+}
+
+// the whole filter chain as one description, so it is parsed into a single graph.
+// when filters are used the pixel format conversion is part of the graph, so every frame is only read once
+static std::string getFilterDescription(const RenderSettings& settings, AVPixelFormat srcFormat, AVPixelFormat dstFormat) {
+    if (settings.m_colorspaceFilters.empty() && settings.m_filters.empty())
+        return {};
+
+    std::vector<std::string> filters;
+    if (srcFormat != dstFormat) {
+        // same matrix and range as the standalone conversion path, the output format is negotiated with the next filter
+        std::string scale = "scale=flags=fast_bilinear";
+        if (usesBt709Matrix(settings, srcFormat, dstFormat))
+            scale += ":out_color_matrix=bt709:out_range=tv";
+        filters.push_back(std::move(scale));
+    }
+
+    if (!settings.m_colorspaceFilters.empty())
+        filters.push_back("colorspace=" + settings.m_colorspaceFilters);
+
+    if (!settings.m_filters.empty())
+        filters.push_back(settings.m_filters);
+
+    // the encoder only accepts its own format
+    filters.push_back(std::string("format=") + av_get_pix_fmt_name(dstFormat));
+
+    std::string description;
+    for (const std::string& filter : filters) {
+        if (!description.empty())
+            description += ',';
+        description += filter;
+    }
+    return description;
+}
+
+// points every plane at its last row and negates the linesize
+static void flipPlanes(uint8_t* data[4], int linesize[4], AVPixelFormat format, int height) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+    int planes = (desc->flags & AV_PIX_FMT_FLAG_PAL) ? 1 : av_pix_fmt_count_planes(format);
+
+    for (int i = 0; i < planes; i++) {
+        int planeHeight = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+        data[i] += static_cast<ptrdiff_t>(linesize[i]) * (planeHeight - 1);
+        linesize[i] = -linesize[i];
     }
-    
-    return vec;
+}
+
+std::vector<std::string> Recorder::getAvailableCodecs() {
+    return codecs::getRegistry().m_available;
+}
+
+std::vector<CodecInfo> Recorder::getCodecInfo() {
+    return codecs::getRegistry().m_codecs;
 }
 
 const AVCodec* getCodecByName(const std::string& name) {
@@ -39,18 +225,369 @@ const AVCodec* getCodecByName(const std::string& name) {
     return nullptr;
 }
 
+// higher compresses better at the same bitrate
+static int getCodecQuality(AVCodecID id) {
+    switch (id) {
+        case AV_CODEC_ID_AV1: return 5;
+        case AV_CODEC_ID_HEVC: return 4;
+        case AV_CODEC_ID_VP9: return 3;
+        case AV_CODEC_ID_H264: return 2;
+        case AV_CODEC_ID_VP8: return 1;
+        default: return 0;
+    }
+}
+
+// a noisy gradient taller than the video, the benchmark scrolls through it so the encoder has motion to search
+static AVFrame* createBenchmarkTexture(AVPixelFormat format, int width, int height) {
+    AVFrame* rgb = av_frame_alloc();
+    AVFrame* texture = av_frame_alloc();
+    SwsContext* sws = sws_getContext(width, height, AV_PIX_FMT_RGB0, width, height, format, SWS_BILINEAR, nullptr, nullptr, nullptr);
+
+    bool ok = rgb && texture && sws;
+    if (ok) {
+        rgb->format = AV_PIX_FMT_RGB0;
+        rgb->width = width;
+        rgb->height = height;
+        texture->format = format;
+        texture->width = width;
+        texture->height = height;
+        ok = av_frame_get_buffer(rgb, 0) >= 0 && av_frame_get_buffer(texture, 0) >= 0;
+    }
+
+    if (ok) {
+        uint32_t seed = 0x9e3779b9;
+        for (int y = 0; y < height; y++) {
+            uint8_t* row = rgb->data[0] + static_cast<ptrdiff_t>(y) * rgb->linesize[0];
+            for (int x = 0; x < width; x++) {
+                seed = seed * 1664525 + 1013904223;
+                uint8_t noise = seed >> 26;
+                row[x * 4 + 0] = static_cast<uint8_t>(x * 255 / width + noise);
+                row[x * 4 + 1] = static_cast<uint8_t>(y * 255 / height + noise);
+                row[x * 4 + 2] = static_cast<uint8_t>((x + y) / 4 + noise);
+                row[x * 4 + 3] = 255;
+            }
+        }
+        ok = sws_scale(sws, rgb->data, rgb->linesize, 0, height, texture->data, texture->linesize) > 0;
+    }
+
+    sws_freeContext(sws);
+    av_frame_free(&rgb);
+    if (!ok)
+        av_frame_free(&texture);
+    return texture;
+}
+
+// encodes a short clip as fast as possible, true if the encoder kept up with the frame rate times AUTO_CODEC_HEADROOM
+static bool benchmarkEncoder(const AVCodec* codec, const RenderSettings& settings) {
+    AVPixelFormat format = getEncoderPixelFormat(codec, static_cast<AVPixelFormat>(settings.m_pixelFormat));
+    if (format == AV_PIX_FMT_NONE)
+        format = codec->pix_fmts[0];
+
+    // hardware frame formats need a device and a frame pool, encoders that only take those are skipped
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+    if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+        return false;
+
+    int width = static_cast<int>(settings.m_width);
+    int height = static_cast<int>(settings.m_height);
+    int frames = std::min<int>(settings.m_fps, AUTO_CODEC_CLIP_FRAMES);
+
+    AVFrame* texture = createBenchmarkTexture(format, width, height + frames * AUTO_CODEC_SCROLL);
+    AVCodecContext* context = avcodec_alloc_context3(codec);
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* packet = av_packet_alloc();
+
+    bool ok = texture && context && frame && packet;
+    if (ok) {
+        context->width = width;
+        context->height = height;
+        context->time_base = AVRational{1, settings.m_fps};
+        context->framerate = AVRational{settings.m_fps, 1};
+        context->bit_rate = settings.m_bitrate;
+        context->pix_fmt = format;
+
+        auto [threads, threadType] = getEncoderThreading(codec, settings);
+        context->thread_count = threads;
+        if (threadType)
+            context->thread_type = threadType;
+
+        AVDictionary* options = nullptr;
+        for (const auto& [key, value] : profiles::getProfileOptions(codec->name, settings.m_encoderProfile))
+            av_dict_set(&options, key, value, 0);
+        for (const auto& [key, value] : settings.m_encoderOptions)
+            av_dict_set(&options, key.c_str(), value.c_str(), 0);
+        ok = avcodec_open2(context, codec, &options) >= 0;
+        av_dict_free(&options);
+    }
+
+    if (ok) {
+        frame->format = format;
+        frame->width = width;
+        frame->height = height;
+        ok = av_frame_get_buffer(frame, 0) >= 0;
+    }
+
+    auto budget = std::chrono::duration<double>(frames / (settings.m_fps * AUTO_CODEC_HEADROOM));
+    auto start = Clock::now();
+
+    // the last iteration flushes the encoder
+    for (int i = 0; ok && i <= frames; i++) {
+        if (i < frames) {
+            ok = av_frame_make_writable(frame) >= 0;
+            if (!ok)
+                break;
+
+            const uint8_t* source[4] = {};
+            for (int plane = 0; plane < 4 && texture->data[plane]; plane++) {
+                bool chroma = (plane == 1 || plane == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+                int row = (i * AUTO_CODEC_SCROLL) >> (chroma ? desc->log2_chroma_h : 0);
+                source[plane] = texture->data[plane] + static_cast<ptrdiff_t>(row) * texture->linesize[plane];
+            }
+            av_image_copy(frame->data, frame->linesize, source, texture->linesize, format, width, height);
+
+            frame->pts = i;
+            ok = avcodec_send_frame(context, frame) >= 0;
+        } else {
+            ok = avcodec_send_frame(context, nullptr) >= 0;
+        }
+
+        int ret = 0;
+        while (ok && (ret = avcodec_receive_packet(context, packet)) >= 0)
+            av_packet_unref(packet);
+        ok = ok && (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF);
+
+        // no point in finishing the clip once it's too slow
+        if (Clock::now() - start > budget)
+            ok = false;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    geode::log::info("Encoder {} took {}ms for {} frames, budget {}ms: {}", codec->name, elapsed.count(), frames,
+        std::chrono::duration_cast<std::chrono::milliseconds>(budget).count(), ok ? "keeps up" : "too slow");
+
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&context);
+    av_frame_free(&texture);
+    return ok;
+}
+
+static const AVOutputFormat* guessOutputFormat(const RenderSettings& settings) {
+    std::string outputFile = settings.m_outputFile.string();
+    return av_guess_format(
+        settings.m_outputFormat.empty() ? nullptr : settings.m_outputFormat.c_str(),
+        outputFile.empty() ? nullptr : outputFile.c_str(), nullptr);
+}
+
+// everything the benchmark result depends on, so a result is never reused for another configuration
+static std::string getSelectionKey(const RenderSettings& settings, const AVOutputFormat* format) {
+    std::string key = std::to_string(settings.m_width) + "x" + std::to_string(settings.m_height) + "@"
+        + std::to_string(settings.m_fps) + "-" + (format ? format->name : "")
+        + "-pix" + std::to_string(static_cast<int>(settings.m_pixelFormat))
+        + "-br" + std::to_string(settings.m_bitrate)
+        + "-profile" + std::to_string(static_cast<int>(settings.m_encoderProfile))
+        + "-threads" + std::to_string(settings.m_encoderThreads)
+        + "-" + std::to_string(static_cast<int>(settings.m_encoderThreadType))
+        + "-reserved" + std::to_string(settings.m_reservedCores);
+
+    // the map's order isn't stable, sort the options so the same set always gives the same key
+    std::vector<std::pair<std::string, std::string>> options(settings.m_encoderOptions.begin(), settings.m_encoderOptions.end());
+    std::ranges::sort(options);
+    for (const auto& [name, value] : options)
+        key += "-" + name + "=" + value;
+    return key;
+}
+
+static std::optional<std::string> getCachedCodec(const codecs::Registry& registry, const std::string& key) {
+    auto cached = codecs::getCachedSelection(key);
+    if (cached && std::ranges::find(registry.m_available, *cached) != registry.m_available.end())
+        return cached;
+    return std::nullopt;
+}
+
+// working encoders the container can hold, best codec first, and within a codec software encoders,
+// they compress better than hardware ones
+static std::vector<const AVCodec*> getCandidates(const codecs::Registry& registry, const AVOutputFormat* format) {
+    std::vector<const AVCodec*> candidates;
+    for (const std::string& name : registry.m_available) {
+        const AVCodec* codec = getCodecByName(name);
+        if (codec && (!format || avformat_query_codec(format, codec->id, FF_COMPLIANCE_NORMAL) != 0))
+            candidates.push_back(codec);
+    }
+
+    std::ranges::stable_sort(candidates, std::ranges::greater{}, [](const AVCodec* codec) {
+        return std::make_pair(getCodecQuality(codec->id), !(codec->capabilities & AV_CODEC_CAP_HARDWARE));
+    });
+    return candidates;
+}
+
+// used until the benchmark for a configuration has finished: a hardware encoder costs no CPU,
+// otherwise H.264 is the cheapest software codec that still compresses well
+static const AVCodec* getFallbackCodec(const std::vector<const AVCodec*>& candidates, AVPixelFormat input) {
+    auto takesFrames = [input](const AVCodec* codec) {
+        AVPixelFormat format = getEncoderPixelFormat(codec, input);
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format == AV_PIX_FMT_NONE ? codec->pix_fmts[0] : format);
+        return desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL);
+    };
+
+    for (const AVCodec* codec : candidates) {
+        if ((codec->capabilities & AV_CODEC_CAP_HARDWARE) && takesFrames(codec))
+            return codec;
+    }
+    for (const AVCodec* codec : candidates) {
+        if (codec->id == AV_CODEC_ID_H264 && takesFrames(codec))
+            return codec;
+    }
+    return candidates.empty() ? nullptr : candidates.back();
+}
+
+// configurations whose benchmark is running in the background, so it's only started once
+static std::mutex s_pendingSelectionMutex;
+static std::vector<std::string> s_pendingSelections;
+
+// the encoder for AUTO_CODEC without waiting for a benchmark. a configuration that wasn't benchmarked yet
+// gets the fallback encoder, and the benchmark runs on its own thread so the next recording can use the result
+static geode::Result<std::string> getAutoCodec(const RenderSettings& settings) {
+    if (settings.m_width == 0 || settings.m_height == 0 || settings.m_fps == 0)
+        return geode::Err("Invalid resolution or frame rate.");
+
+    const AVOutputFormat* format = guessOutputFormat(settings);
+    std::string key = getSelectionKey(settings, format);
+
+    const codecs::Registry& registry = codecs::getRegistry();
+    if (auto cached = getCachedCodec(registry, key))
+        return geode::Ok(*cached);
+
+    const AVCodec* fallback = getFallbackCodec(getCandidates(registry, format), static_cast<AVPixelFormat>(settings.m_pixelFormat));
+    if (!fallback)
+        return geode::Err("No working encoder can be stored in this container.");
+
+    {
+        std::lock_guard lock(s_pendingSelectionMutex);
+        if (std::ranges::find(s_pendingSelections, key) == s_pendingSelections.end()) {
+            s_pendingSelections.push_back(key);
+
+            // only what the benchmark reads is copied, the output and callbacks stay with the recorder
+            RenderSettings benchmark;
+            benchmark.m_width = settings.m_width;
+            benchmark.m_height = settings.m_height;
+            benchmark.m_fps = settings.m_fps;
+            benchmark.m_bitrate = settings.m_bitrate;
+            benchmark.m_pixelFormat = settings.m_pixelFormat;
+            benchmark.m_outputFile = settings.m_outputFile;
+            benchmark.m_outputFormat = settings.m_outputFormat;
+            benchmark.m_encoderProfile = settings.m_encoderProfile;
+            benchmark.m_encoderOptions = settings.m_encoderOptions;
+            benchmark.m_encoderThreads = settings.m_encoderThreads;
+            benchmark.m_encoderThreadType = settings.m_encoderThreadType;
+            benchmark.m_reservedCores = settings.m_reservedCores;
+
+            std::thread([benchmark, key] {
+                (void) Recorder::selectCodec(benchmark);
+                std::lock_guard lock(s_pendingSelectionMutex);
+                std::erase(s_pendingSelections, key);
+            }).detach();
+        }
+    }
+
+    geode::log::info("No encoder was benchmarked for {} yet, using {} meanwhile", key, fallback->name);
+    return geode::Ok(std::string(fallback->name));
+}
+
+geode::Result<std::string> Recorder::selectCodec(const RenderSettings& settings) {
+    if (settings.m_width == 0 || settings.m_height == 0 || settings.m_fps == 0)
+        return geode::Err("Invalid resolution or frame rate.");
+
+    // only encoders the container can hold are candidates
+    const AVOutputFormat* format = guessOutputFormat(settings);
+    std::string key = getSelectionKey(settings, format);
+
+    const codecs::Registry& registry = codecs::getRegistry();
+    if (auto cached = getCachedCodec(registry, key))
+        return geode::Ok(*cached);
+
+    for (const AVCodec* codec : getCandidates(registry, format)) {
+        if (!benchmarkEncoder(codec, settings))
+            continue;
+
+        geode::log::info("Selected encoder {} for {}", codec->name, key);
+        codecs::cacheSelection(key, codec->name);
+        return geode::Ok(std::string(codec->name));
+    }
+
+    return geode::Err("No encoder keeps up with " + std::to_string(settings.m_width) + "x" + std::to_string(settings.m_height)
+        + " at " + std::to_string(settings.m_fps) + " fps.");
+}
+
 geode::Result<> Recorder::Impl::init(const RenderSettings& settings) {
-    int ret = avformat_alloc_output_context2(&m_formatContext, NULL, NULL, settings.m_outputFile.string().c_str());
-    if (!m_formatContext)
-        return geode::Err("Could not create output context: " + utils::getErrorString(ret));
+    // continue as if the selected encoder had been requested, init never waits for a benchmark
+    if (settings.m_codec == AUTO_CODEC) {
+        geode::Result<std::string> codec = getAutoCodec(settings);
+        if (codec.isErr())
+            return geode::Err(codec.unwrapErr());
+
+        RenderSettings resolved = settings;
+        resolved.m_codec = codec.unwrap();
+        return init(resolved);
+    }
+
+    bool toFile = !settings.m_outputCallbacks.m_write && !settings.m_outputBuffer;
+    if (!toFile && settings.m_outputFormat.empty())
+        return geode::Err("RenderSettings::m_outputFormat is required when not writing to a file.");
+
+    m_settings = settings;
+    m_outputFile = settings.m_outputFile;
+    m_fragmentedOutput = settings.m_fragmentedOutput;
+    m_segmentSize = settings.m_segmentSize;
+    m_segmentDuration = 0;
+    m_segmentIndex = 0;
+    m_segmentOffset = 0;
+    m_segmentBytes = 0;
+    m_segmentStart = AV_NOPTS_VALUE;
+    m_nextKeyframePts = AV_NOPTS_VALUE;
+    m_segmentError.clear();
+    m_segmentCallback = settings.m_segmentCallback;
+    m_segmentPath = settings.m_outputFile;
+
+    bool segmented = settings.m_segmentDuration > 0.0 || settings.m_segmentSize > 0;
+    if (segmented && !toFile)
+        return geode::Err("Segmented recording needs a file output.");
+    if (segmented)
+        m_segmentPath = getSegmentPath(settings.m_outputFile, 0);
+
+    // in replay mode nothing is muxed until saveReplay
+    bool replay = settings.m_replayDuration > 0.0;
+    if (replay && segmented)
+        return geode::Err("Replay mode can't be combined with segmented recording.");
+    if (replay && !settings.m_audioCodec.empty())
+        return geode::Err("Replay mode can't record an audio track.");
+    if (replay && settings.m_chunkFrames > 0)
+        return geode::Err("Replay mode can't be combined with chunked encoding.");
+    if (replay && settings.m_replayMaxBytes == 0)
+        return geode::Err("Replay mode needs a non-zero m_replayMaxBytes.");
+
+    int ret = 0;
+    if (!replay) {
+        ret = avformat_alloc_output_context2(
+            &m_formatContext, nullptr,
+            settings.m_outputFormat.empty() ? nullptr : settings.m_outputFormat.c_str(),
+            toFile ? m_segmentPath.string().c_str() : nullptr);
+        if (!m_formatContext)
+            return geode::Err("Could not create output context: " + utils::getErrorString(ret));
+
+        if (segmented && (m_formatContext->oformat->flags & AVFMT_NOFILE))
+            return geode::Err("Segmented recording is not supported for " + std::string(m_formatContext->oformat->name) + ".");
+    }
 
     m_codec = getCodecByName(settings.m_codec);
     if (!m_codec)
         return geode::Err("Could not find encoder.");
 
-    m_videoStream = avformat_new_stream(m_formatContext, m_codec);
-    if (!m_videoStream)
-        return geode::Err("Could not create video stream.");
+    if (m_formatContext) {
+        m_videoStream = avformat_new_stream(m_formatContext, m_codec);
+        if (!m_videoStream)
+            return geode::Err("Could not create video stream.");
+    }
 
     m_codecContext = avcodec_alloc_context3(m_codec);
     if (!m_codecContext)
@@ -65,25 +602,26 @@ geode::Result<> Recorder::Impl::init(const RenderSettings& settings) {
     m_codecContext->width = settings.m_width;
     m_codecContext->height = settings.m_height;
     m_codecContext->time_base = AVRational{1, settings.m_fps};
+    m_codecContext->framerate = AVRational{settings.m_fps, 1};
     m_codecContext->pix_fmt = AV_PIX_FMT_NONE;
-    m_videoStream->time_base = m_codecContext->time_base;
+
+    // caller timestamps need a fine time base, m_fps stays the nominal rate for rate control.
+    // mpeg4 can't store a time base denominator above 65535
+    m_variableFrameRate = settings.m_variableFrameRate;
+    if (m_variableFrameRate)
+        m_codecContext->time_base = m_codec->id == AV_CODEC_ID_MPEG4 ? AVRational{1, 60000} : AVRational{1, 90000};
+
+    if (m_videoStream)
+        m_videoStream->time_base = m_codecContext->time_base;
+    m_frameDuration = av_rescale_q(1, av_inv_q(m_codecContext->framerate), m_codecContext->time_base);
+    if (settings.m_segmentDuration > 0.0)
+        m_segmentDuration = std::max<int64_t>(std::llround(settings.m_segmentDuration / av_q2d(m_codecContext->time_base)), 1);
+    m_lastPts = AV_NOPTS_VALUE;
 
     if(!m_codecContext->pix_fmt)
         return geode::Err("Codec does not have any supported pixel formats.");
 
-    if (const AVPixelFormat *pix_fmt = m_codec->pix_fmts) {
-        while (*pix_fmt != AV_PIX_FMT_NONE) {
-            if(*pix_fmt == AV_PIX_FMT_MEDIACODEC) {
-                // secretly force pix fmt to nv12. seems to work contrary to yuv420p.
-                // with AV_PIX_FMT_MEDIACODEC mediacodec would go into surface mode and expect a surface
-                m_codecContext->pix_fmt = AV_PIX_FMT_NV12; 
-                break;
-            }
-            if(*pix_fmt == static_cast<AVPixelFormat>(settings.m_pixelFormat))
-                m_codecContext->pix_fmt = *pix_fmt;
-            ++pix_fmt;
-        }
-    }
+    m_codecContext->pix_fmt = getEncoderPixelFormat(m_codec, static_cast<AVPixelFormat>(settings.m_pixelFormat));
     if(m_codecContext->pix_fmt == AV_PIX_FMT_NONE) {
         geode::log::info("Codec {} does not support pixel format, defaulting to codec's format", settings.m_codec);
         m_codecContext->pix_fmt = m_codec->pix_fmts[0];
@@ -91,38 +629,102 @@ geode::Result<> Recorder::Impl::init(const RenderSettings& settings) {
     else
         geode::log::info("Codec {} supports pixel format.", settings.m_codec);
 
-    if (ret = avcodec_open2(m_codecContext, m_codec, nullptr); ret < 0)
-        return geode::Err("Could not open codec: " + utils::getErrorString(ret));
+    // RGB input is converted with the BT.709 matrix, tag the stream so players decode it the same way
+    if (usesBt709Matrix(settings, (AVPixelFormat)settings.m_pixelFormat, m_codecContext->pix_fmt)) {
+        m_codecContext->colorspace = AVCOL_SPC_BT709;
+        m_codecContext->color_primaries = AVCOL_PRI_BT709;
+        m_codecContext->color_trc = AVCOL_TRC_BT709;
+        m_codecContext->color_range = AVCOL_RANGE_MPEG;
+    }
 
-    if (m_formatContext->oformat->flags & AVFMT_GLOBALHEADER)
+    AVDictionary* codecOptions = nullptr;
+    for (const auto& [key, value] : profiles::getProfileOptions(settings.m_codec, settings.m_encoderProfile))
+        av_dict_set(&codecOptions, key, value, 0);
+    for (const auto& [key, value] : settings.m_encoderOptions)
+        av_dict_set(&codecOptions, key.c_str(), value.c_str(), 0);
+
+    // chunks are concatenated, so no frame may reference one before its chunk. without B-frames every chunk's
+    // decode timestamps equal its presentation timestamps, and they continue where the previous chunk ended
+    if (settings.m_chunkFrames > 0) {
+        m_codecContext->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+        m_codecContext->max_b_frames = 0;
+        if (av_dict_get(codecOptions, "bf", nullptr, 0)) {
+            geode::log::warn("Codec option bf is ignored in chunked mode");
+            av_dict_set(&codecOptions, "bf", nullptr, 0);
+        }
+    }
+
+    // chunk encoders are opened with the same options later
+    m_codecOptions.clear();
+    const AVDictionaryEntry* option = nullptr;
+    while ((option = av_dict_iterate(codecOptions, option)))
+        m_codecOptions.emplace_back(option->key, option->value);
+
+    auto [threads, threadType] = getEncoderThreading(m_codec, settings);
+    m_codecContext->thread_count = threads;
+    if (threadType)
+        m_codecContext->thread_type = threadType;
+
+    // in chunked mode this encoder never sees a frame, it's only opened for the extradata and the stream parameters
+    if (settings.m_chunkFrames > 0)
+        m_codecContext->thread_count = 1;
+
+    // has to be set before opening the codec, otherwise it won't produce the extradata the muxer needs.
+    // the container of a replay isn't known yet, muxers without global headers get them from the extradata
+    if (replay || (m_formatContext->oformat->flags & AVFMT_GLOBALHEADER))
         m_codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
-    if (ret = avcodec_parameters_from_context(m_videoStream->codecpar, m_codecContext); ret < 0)
-        return geode::Err("Could not copy codec parameters: " + utils::getErrorString(ret));
+    ret = avcodec_open2(m_codecContext, m_codec, &codecOptions);
 
-    if (!(m_formatContext->oformat->flags & AVFMT_NOFILE)) {
-        if (ret = avio_open(&m_formatContext->pb, settings.m_outputFile.string().c_str(), AVIO_FLAG_WRITE); ret < 0)
-            return geode::Err("Could not open output file: " + utils::getErrorString(ret));
+    // whatever is left in the dictionary wasn't recognized by the codec
+    const AVDictionaryEntry* unusedOption = nullptr;
+    while ((unusedOption = av_dict_iterate(codecOptions, unusedOption)))
+        geode::log::warn("Codec {} does not support option {}={}", settings.m_codec, unusedOption->key, unusedOption->value);
+    av_dict_free(&codecOptions);
+
+    if (ret < 0)
+        return geode::Err("Could not open codec: " + utils::getErrorString(ret));
+
+    // external libraries take the count as is
+    m_encoderThreads = static_cast<uint32_t>(m_codecContext->thread_count);
+    m_encoderThreadType = getActiveThreadType(m_codec, m_codecContext);
+
+    geode::log::info("Codec {} uses {} threads", settings.m_codec, m_encoderThreads);
+
+    if (replay) {
+        int64_t duration = std::llround(settings.m_replayDuration / av_q2d(m_codecContext->time_base));
+        m_replayBuffer = new replay::ReplayBuffer(settings.m_replayMaxBytes, duration);
     }
+    else {
+        if (ret = avcodec_parameters_from_context(m_videoStream->codecpar, m_codecContext); ret < 0)
+            return geode::Err("Could not copy codec parameters: " + utils::getErrorString(ret));
 
-    if (ret = avformat_write_header(m_formatContext, nullptr); ret < 0)
-        return geode::Err("Could not write header: " + utils::getErrorString(ret));
+        if (!settings.m_audioCodec.empty()) {
+            if (geode::Result<> res = initAudio(settings); res.isErr())
+                return res;
+        }
+
+        if (geode::Result<> res = openOutput(settings); res.isErr())
+            return res;
+
+        if (geode::Result<> res = writeHeader(); res.isErr())
+            return res;
+    }
 
+    if (settings.m_chunkFrames > 0)
+        createChunkEncoder();
+
+    //m_frame should always have the pixel format of the settings, if the codec does not support it, it will be converted in writeFrame.
+    //it only describes the caller's buffer, the data pointers are filled in writeFrame
     m_frame = av_frame_alloc();
     m_frame->format = (AVPixelFormat)settings.m_pixelFormat;
     m_frame->width = m_codecContext->width;
     m_frame->height = m_codecContext->height;
 
-    //m_frame should always have the pixel format of the settings, if the codec does not support it, it will be converted in writeFrame
-    if (ret = av_image_alloc(m_frame->data, m_frame->linesize, m_codecContext->width, m_codecContext->height, (AVPixelFormat)settings.m_pixelFormat, 32); ret < 0)
-        return geode::Err("Could not allocate raw picture buffer: " + utils::getErrorString(ret));
-
     m_convertedFrame = av_frame_alloc();
-    m_convertedFrame->format = m_codecContext->pix_fmt;
-    m_convertedFrame->width = m_codecContext->width;
-    m_convertedFrame->height = m_codecContext->height;
-    if(ret = av_image_alloc(m_convertedFrame->data, m_convertedFrame->linesize, m_convertedFrame->width, m_convertedFrame->height, m_codecContext->pix_fmt, 32); ret < 0)
-        return geode::Err("Could not allocate raw picture buffer: " + utils::getErrorString(ret));
+    m_convertedPool = av_buffer_pool_init(av_image_get_buffer_size(m_codecContext->pix_fmt, m_codecContext->width, m_codecContext->height, 32), nullptr);
+    if (!m_convertedPool)
+        return geode::Err("Could not allocate raw picture buffer.");
 
     m_filteredFrame = av_frame_alloc();
 
@@ -131,208 +733,1815 @@ geode::Result<> Recorder::Impl::init(const RenderSettings& settings) {
     m_packet->data = nullptr;
     m_packet->size = 0;
 
-    if(!settings.m_colorspaceFilters.empty() || settings.m_doVerticalFlip) {
-        m_filterGraph = avfilter_graph_alloc();
-        if (!m_filterGraph)
-            return geode::Err("Could not allocate filter graph.");
-
-        const AVFilter* buffersrc = avfilter_get_by_name("buffer");
-        const AVFilter* buffersink = avfilter_get_by_name("buffersink");
-        const AVFilter* colorspace = avfilter_get_by_name("colorspace");
-        const AVFilter* vflip = avfilter_get_by_name("vflip");
-
-        char args[512];
-            snprintf(args, sizeof(args),
-                "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
-                m_codecContext->width, m_codecContext->height, m_codecContext->pix_fmt,
-                m_codecContext->time_base.num, m_codecContext->time_base.den,
-                m_codecContext->sample_aspect_ratio.num, m_codecContext->sample_aspect_ratio.den);
-
-        if(ret = avfilter_graph_create_filter(&m_buffersrcCtx, buffersrc, "in", args, nullptr, m_filterGraph); ret < 0) {
-            avfilter_graph_free(&m_filterGraph);
-            return geode::Err("Could not create input for filter graph: " + utils::getErrorString(ret));
-        }
-
-        if(ret = avfilter_graph_create_filter(&m_buffersinkCtx, buffersink, "out", nullptr, nullptr, m_filterGraph); ret < 0) {
-            avfilter_graph_free(&m_filterGraph);
-            return geode::Err("Could not create output for filter graph: " + utils::getErrorString(ret));
-        }
-
-        if(!settings.m_colorspaceFilters.empty()) {
-            if(ret = avfilter_graph_create_filter(&m_colorspaceCtx, colorspace, "colorspace", settings.m_colorspaceFilters.c_str(), nullptr, m_filterGraph); ret < 0) {
-                avfilter_graph_free(&m_filterGraph);
-                return geode::Err("Could not create colorspace for filter graph: " + utils::getErrorString(ret));
-            }
-
-            if(ret = avfilter_link(m_buffersrcCtx, 0, m_colorspaceCtx, 0); ret < 0) {
-                avfilter_graph_free(&m_filterGraph);
-                return geode::Err("Could not link filters: " + utils::getErrorString(ret));
-            }
-
-            if(ret = avfilter_link(m_colorspaceCtx, 0, m_buffersinkCtx, 0); ret < 0) {
-                avfilter_graph_free(&m_filterGraph);
-                return geode::Err("Could not link filters: " + utils::getErrorString(ret));
-            }
-        }
-
-        if(settings.m_doVerticalFlip) {
-            if(ret = avfilter_graph_create_filter(&m_vflipCtx, vflip, "vflip", nullptr, nullptr, m_filterGraph); ret < 0) {
-                avfilter_graph_free(&m_filterGraph);
-                return geode::Err("Could not create vflip for filter graph: " + utils::getErrorString(ret));
-            }
+    // the vertical flip is done while converting, or by feeding the graph a bottom-up view of the frame
+    m_doVerticalFlip = settings.m_doVerticalFlip;
 
-            if(ret = avfilter_link(m_buffersrcCtx, 0, m_vflipCtx, 0); ret < 0) {
-                avfilter_graph_free(&m_filterGraph);
-                return geode::Err("Could not link filters: " + utils::getErrorString(ret));
-            }
+    std::string filters = getFilterDescription(settings, (AVPixelFormat)settings.m_pixelFormat, m_codecContext->pix_fmt);
+    if(!filters.empty()) {
+        if (geode::Result<> res = createFilterGraph(filters, (AVPixelFormat)settings.m_pixelFormat, settings.m_filterThreads); res.isErr())
+            return res;
 
-            if(ret = avfilter_link(m_vflipCtx, 0, m_buffersinkCtx, 0); ret < 0) {
-                avfilter_graph_free(&m_filterGraph);
-                return geode::Err("Could not link filters: " + utils::getErrorString(ret));
-            }
-        }
+        // custom filters may keep frames around after returning, so borrowed data has to be copied by buffersrc
+        m_graphRetainsFrames = !settings.m_filters.empty();
+        m_sourceView = av_frame_alloc();
+    }
 
-        if (ret = avfilter_graph_config(m_filterGraph, nullptr); ret < 0) {
-            avfilter_graph_free(&m_filterGraph);
-            return geode::Err("Could not configure filter graph: " + utils::getErrorString(ret));
+    if((AVPixelFormat)settings.m_pixelFormat != m_codecContext->pix_fmt && !m_filterGraph) {
+        // hand-vectorized kernels for the common RGB to 4:2:0 case, swscale handles everything else
+        if (auto fast = convert::getFastConverter((AVPixelFormat)settings.m_pixelFormat, m_codecContext->pix_fmt, m_codecContext->width, m_codecContext->height)) {
+            if (convert::verifyFastConverter(*fast, (AVPixelFormat)settings.m_pixelFormat, m_codecContext->pix_fmt))
+                m_fastConverter = new convert::FastConverter(*fast);
+            else
+                geode::log::warn("Fast {} pixel conversion does not match swscale, falling back", fast->m_name);
         }
     }
 
-    if((AVPixelFormat)settings.m_pixelFormat != m_codecContext->pix_fmt) {
-        m_swsCtx = sws_getContext(m_codecContext->width, m_codecContext->height, (AVPixelFormat)settings.m_pixelFormat, m_codecContext->width,
-            m_codecContext->height, m_codecContext->pix_fmt, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
-
+    if((AVPixelFormat)settings.m_pixelFormat != m_codecContext->pix_fmt && !m_fastConverter && !m_filterGraph) {
+        m_swsCtx = createSwsContext(getConversionThreads(settings));
         if (!m_swsCtx)
             return geode::Err("Could not create sws context.");
+
+        m_sourceView = av_frame_alloc();
     }
 
     m_frameCount = 0;
+    m_nextPts = 0;
     m_expectedSize = av_image_get_buffer_size((AVPixelFormat)m_frame->format, m_frame->width, m_frame->height, 1);
 
+    // over-allocated so the frame can start on a 64-byte boundary
+    m_inputPool = av_buffer_pool_init(m_expectedSize + FRAME_ALIGNMENT - 1, nullptr);
+    if (!m_inputPool)
+        return geode::Err("Could not allocate frame pool.");
+
+    m_timingCallback = settings.m_timingCallback;
+
+    if(settings.m_skipDuplicateFrames) {
+        m_frameHasher = new hash::FrameHasher(hash::getFrameHasher());
+        m_hashRowSize = std::max(av_image_get_linesize((AVPixelFormat)m_frame->format, m_frame->width, 0), 1);
+    }
+
+    m_async = settings.m_asyncEncode;
+    if(m_async) {
+        m_maxQueuedFrames = std::max<size_t>(settings.m_maxQueuedFrames, 1);
+        m_dropFramesWhenFull = settings.m_dropFramesWhenFull;
+        m_stopRequested = false;
+        m_asyncError.clear();
+
+        m_encodeThread = std::thread(&Impl::encodeLoop, this);
+    }
+
     m_init = true;
 
     return geode::Ok();
 }
 
-geode::Result<> Recorder::Impl::writeFrame(std::span<uint8_t const> frameData) {
-    if (!m_init || !m_frame)
-        return geode::Err("Recorder is not initialized.");
+geode::Result<> Recorder::Impl::createFilterGraph(const std::string& filters, int format, uint32_t threads) {
+    int ret = 0;
+    m_filterGraph = avfilter_graph_alloc();
+    if (!m_filterGraph)
+        return geode::Err("Could not allocate filter graph.");
 
-    if(frameData.size() != m_expectedSize)
-        return geode::Err("Frame data size does not match expected dimensions.");
+    // has to be set before any filter is created, 0 lets FFmpeg use every core
+    m_filterGraph->nb_threads = static_cast<int>(threads);
+    m_filterGraph->thread_type = AVFILTER_THREAD_SLICE;
 
-    int ret = av_image_fill_arrays(
-        m_frame->data,
-        m_frame->linesize,
-        frameData.data(),
-        (AVPixelFormat)m_frame->format,
-        m_frame->width,
-        m_frame->height,
-        1
-    );
+    const AVFilter* buffersrc = avfilter_get_by_name("buffer");
+    const AVFilter* buffersink = avfilter_get_by_name("buffersink");
 
-    if (ret < 0)
-        return geode::Err("Failed to fill image arrays: " + utils::getErrorString(ret));
+    char args[512];
+        snprintf(args, sizeof(args),
+            "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+            m_codecContext->width, m_codecContext->height, format,
+            m_codecContext->time_base.num, m_codecContext->time_base.den,
+            m_codecContext->sample_aspect_ratio.num, m_codecContext->sample_aspect_ratio.den);
 
-    if(m_swsCtx) {
-        sws_scale(
-            m_swsCtx, m_frame->data, m_frame->linesize, 0, m_frame->height,
-            m_convertedFrame->data, m_convertedFrame->linesize);
-    }
-    else {
-        av_frame_copy(m_convertedFrame, m_frame);
-        av_frame_copy_props(m_convertedFrame, m_frame);
+    if(ret = avfilter_graph_create_filter(&m_buffersrcCtx, buffersrc, "in", args, nullptr, m_filterGraph); ret < 0) {
+        avfilter_graph_free(&m_filterGraph);
+        return geode::Err("Could not create input for filter graph: " + utils::getErrorString(ret));
     }
 
-    if(m_buffersrcCtx) {
-        geode::Result<> res = filterFrame(m_convertedFrame, m_filteredFrame);
-
-        if(res.isErr())
-            return res;
-
-        av_frame_copy(m_convertedFrame, m_filteredFrame);
-        av_frame_copy_props(m_convertedFrame, m_filteredFrame);
+    if(ret = avfilter_graph_create_filter(&m_buffersinkCtx, buffersink, "out", nullptr, nullptr, m_filterGraph); ret < 0) {
+        avfilter_graph_free(&m_filterGraph);
+        return geode::Err("Could not create output for filter graph: " + utils::getErrorString(ret));
     }
 
-    m_convertedFrame->pts = m_frameCount++;
+    // the description's unlabeled input and output get connected to buffersrc and buffersink
+    AVFilterInOut* outputs = avfilter_inout_alloc();
+    AVFilterInOut* inputs = avfilter_inout_alloc();
+    if (!outputs || !inputs) {
+        avfilter_inout_free(&outputs);
+        avfilter_inout_free(&inputs);
+        avfilter_graph_free(&m_filterGraph);
+        return geode::Err("Could not allocate filter graph endpoints.");
+    }
 
-    ret = avcodec_send_frame(m_codecContext, m_convertedFrame);
-    if (ret < 0)
-        return geode::Err("Error while sending frame: " + utils::getErrorString(ret));
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = m_buffersrcCtx;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
 
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(m_codecContext, m_packet);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-            break;
-        if (ret < 0)
-            return geode::Err("Error while receiving packet: " + utils::getErrorString(ret));
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = m_buffersinkCtx;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
 
-        av_packet_rescale_ts(m_packet, m_codecContext->time_base, m_videoStream->time_base);
-        m_packet->stream_index = m_videoStream->index;
+    ret = avfilter_graph_parse_ptr(m_filterGraph, filters.c_str(), &inputs, &outputs, nullptr);
+    avfilter_inout_free(&outputs);
+    avfilter_inout_free(&inputs);
 
-        av_interleaved_write_frame(m_formatContext, m_packet);
-        av_packet_unref(m_packet);
+    if (ret < 0) {
+        avfilter_graph_free(&m_filterGraph);
+        return geode::Err("Could not parse filter graph \"" + filters + "\": " + utils::getErrorString(ret));
     }
 
-    av_frame_unref(m_filteredFrame);
+    if (ret = avfilter_graph_config(m_filterGraph, nullptr); ret < 0) {
+        avfilter_graph_free(&m_filterGraph);
+        return geode::Err("Could not configure filter graph: " + utils::getErrorString(ret));
+    }
 
     return geode::Ok();
 }
 
-geode::Result<> Recorder::Impl::filterFrame(AVFrame* inputFrame, AVFrame* outputFrame) {
-    int ret = 0;
-    if (ret = av_buffersrc_add_frame(m_buffersrcCtx, inputFrame); ret < 0) {
-        avfilter_graph_free(&m_filterGraph);
-        return geode::Err("Could not feed frame to filter graph: " + utils::getErrorString(ret));
-    }
+geode::Result<int64_t> Recorder::Impl::nextTimestamp(std::optional<int64_t> timestampMicros) {
+    if (!m_variableFrameRate) {
+        if (timestampMicros)
+            return geode::Err("Frame timestamps require RenderSettings::m_variableFrameRate.");
 
-    if (ret = av_buffersink_get_frame(m_buffersinkCtx, outputFrame); ret < 0) {
-        av_frame_unref(outputFrame);
-        return geode::Err("Could not retrieve frame from filter graph: " + utils::getErrorString(ret));
+        m_frameCount++;
+        return geode::Ok(m_nextPts++);
     }
 
+    // frames without a timestamp follow the previous one at the nominal frame rate
+    int64_t pts = timestampMicros
+        ? av_rescale_q(*timestampMicros, AVRational{1, 1000000}, m_codecContext->time_base)
+        : (m_lastPts == AV_NOPTS_VALUE ? 0 : m_lastPts + m_frameDuration);
+
+    if (m_lastPts != AV_NOPTS_VALUE && pts <= m_lastPts)
+        return geode::Err("Frame timestamps must be strictly increasing.");
+
+    m_lastPts = pts;
+    m_frameCount++;
+    return geode::Ok(pts);
+}
+
+geode::Result<> Recorder::Impl::setTimestamp(AVFrame* frame, std::optional<int64_t> timestampMicros) {
+    geode::Result<int64_t> pts = nextTimestamp(timestampMicros);
+    if (pts.isErr())
+        return geode::Err(pts.unwrapErr());
+
+    frame->pts = pts.unwrap();
+    frame->duration = m_frameDuration;
     return geode::Ok();
 }
 
-void Recorder::Impl::stop() {
-    if(m_codecContext && m_videoStream && m_formatContext && m_packet) {
-        avcodec_send_frame(m_codecContext, nullptr);
-        while (avcodec_receive_packet(m_codecContext, m_packet) == 0) {
-            av_packet_rescale_ts(m_packet, m_codecContext->time_base, m_videoStream->time_base);
-            m_packet->stream_index = m_videoStream->index;
-            av_interleaved_write_frame(m_formatContext, m_packet);
-            av_packet_unref(m_packet);
-        }
+geode::Result<bool> Recorder::Impl::skipDuplicate(const uint8_t* data, AVBufferRef*& buffer, std::optional<int64_t> timestampMicros) {
+    if (!m_frameHasher)
+        return geode::Ok(false);
+
+    uint64_t hash = m_frameHasher->hash(data, m_expectedSize, m_hashRowSize);
+    bool duplicate = m_lastFrameHash == hash;
+    m_lastFrameHash = hash;
+
+    if (!duplicate) {
+        m_skippedTailPts.reset();
+        av_buffer_unref(&m_duplicateBuffer);
+        return geode::Ok(false);
     }
 
-    if(m_formatContext)
-        av_write_trailer(m_formatContext);
+    // the previous frame is simply shown longer, only the timestamp advances
+    geode::Result<int64_t> pts = nextTimestamp(timestampMicros);
+    if (pts.isErr())
+        return geode::Err(pts.unwrapErr());
 
-    if(m_codecContext)
-        avcodec_free_context(&m_codecContext);
+    m_skippedTailPts = pts.unwrap();
+    m_framesSkipped++;
 
-    if(m_frame)
-        av_frame_free(&m_frame);
-    if(m_convertedFrame)
-        av_frame_free(&m_convertedFrame);
+    // one copy of the repeated frame is kept, stop() encodes it again if the recording ends on skipped frames
+    if (!m_duplicateBuffer) {
+        if (buffer) {
+            m_duplicateBuffer = buffer;
+            m_duplicateData = const_cast<uint8_t*>(data);
+            buffer = nullptr;
+        }
+        else {
+            m_duplicateBuffer = av_buffer_pool_get(m_inputPool);
+            if (!m_duplicateBuffer)
+                return geode::Err("Could not allocate frame buffer.");
 
-    if(m_formatContext) {
-        if (!(m_formatContext->oformat->flags & AVFMT_NOFILE)) {
-            avio_close(m_formatContext->pb);
+            m_duplicateData = alignFrameData(m_duplicateBuffer->data);
+            std::memcpy(m_duplicateData, data, m_expectedSize);
         }
-        avformat_free_context(m_formatContext);
     }
 
-    if(m_filterGraph) {
-        avfilter_graph_free(&m_filterGraph);
-        av_frame_free(&m_filteredFrame);
-    }
+    av_buffer_unref(&buffer);
+    return geode::Ok(true);
+}
 
-    if (m_hwDevice)
-        av_buffer_unref(&m_hwDevice);
+geode::Result<> Recorder::Impl::encodeSkippedTail() {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame)
+        return geode::Err("Could not allocate frame.");
 
-    if(m_packet)
-        av_packet_free(&m_packet);
+    frame->format = m_frame->format;
+    frame->width = m_frame->width;
+    frame->height = m_frame->height;
+    frame->buf[0] = m_duplicateBuffer;
+    m_duplicateBuffer = nullptr;
+
+    av_image_fill_arrays(
+        frame->data, frame->linesize, m_duplicateData,
+        (AVPixelFormat)frame->format, frame->width, frame->height, 1);
+
+    frame->pts = *m_skippedTailPts;
+    frame->duration = m_frameDuration;
+    m_skippedTailPts.reset();
+
+    geode::Result<> res = encodeFrame(frame);
+    av_frame_free(&frame);
+    return res;
+}
+
+geode::Result<> Recorder::Impl::writeFrame(std::span<uint8_t const> frameData, std::optional<int64_t> timestampMicros) {
+    if (!m_init || !m_frame)
+        return geode::Err("Recorder is not initialized.");
+
+    if(frameData.size() != m_expectedSize)
+        return geode::Err("Frame data size does not match expected dimensions.");
+
+    AVBufferRef* borrowed = nullptr;
+    geode::Result<bool> duplicate = skipDuplicate(frameData.data(), borrowed, timestampMicros);
+    if(duplicate.isErr())
+        return geode::Err(duplicate.unwrapErr());
+    if(duplicate.unwrap())
+        return geode::Ok();
+
+    if(m_async) {
+        geode::Result<bool> space = waitForQueueSpace();
+        if(space.isErr())
+            return geode::Err(space.unwrapErr());
+
+        if(!space.unwrap()) {
+            // keep the timestamp slot so the encoded video stays in sync
+            m_frameCount++;
+            m_nextPts++;
+            m_framesDropped++;
+            return geode::Ok();
+        }
+
+        // the caller's buffer is only borrowed, so it has to be copied before queueing
+        AVBufferRef* buffer = av_buffer_pool_get(m_inputPool);
+        if (!buffer)
+            return geode::Err("Could not allocate frame buffer.");
+
+        uint8_t* data = alignFrameData(buffer->data);
+        std::memcpy(data, frameData.data(), frameData.size());
+
+        return submitBuffer(buffer, data, timestampMicros);
+    }
+
+    int ret = av_image_fill_arrays(
+        m_frame->data,
+        m_frame->linesize,
+        frameData.data(),
+        (AVPixelFormat)m_frame->format,
+        m_frame->width,
+        m_frame->height,
+        1
+    );
+
+    if (ret < 0)
+        return geode::Err("Failed to fill image arrays: " + utils::getErrorString(ret));
+
+    if (geode::Result<> res = setTimestamp(m_frame, timestampMicros); res.isErr())
+        return res;
+
+    return encodeFrame(m_frame);
+}
+
+geode::Result<> Recorder::Impl::writeFrame(std::vector<uint8_t>&& frameData) {
+    if (!m_init || !m_frame)
+        return geode::Err("Recorder is not initialized.");
+
+    if(frameData.size() != m_expectedSize)
+        return geode::Err("Frame data size does not match expected dimensions.");
+
+    AVBufferRef* borrowed = nullptr;
+    geode::Result<bool> duplicate = skipDuplicate(frameData.data(), borrowed, std::nullopt);
+    if(duplicate.isErr())
+        return geode::Err(duplicate.unwrapErr());
+    if(duplicate.unwrap())
+        return geode::Ok();
+
+    if(m_async) {
+        geode::Result<bool> space = waitForQueueSpace();
+        if(space.isErr())
+            return geode::Err(space.unwrapErr());
+
+        if(!space.unwrap()) {
+            m_frameCount++;
+            m_nextPts++;
+            m_framesDropped++;
+            return geode::Ok();
+        }
+    }
+
+    // the vector is kept alive by the buffer until the encoder and filter graph are done with it
+    auto owned = new std::vector<uint8_t>(std::move(frameData));
+    AVBufferRef* buffer = av_buffer_create(owned->data(), owned->size(), [](void* opaque, uint8_t*) {
+        delete static_cast<std::vector<uint8_t>*>(opaque);
+    }, owned, 0);
+
+    if (!buffer) {
+        delete owned;
+        return geode::Err("Could not allocate frame buffer.");
+    }
+
+    return submitBuffer(buffer, buffer->data);
+}
+
+geode::Result<FrameHandle> Recorder::Impl::acquireFrame() {
+    if (!m_init || !m_inputPool)
+        return geode::Err("Recorder is not initialized.");
+
+    AVBufferRef* buffer = av_buffer_pool_get(m_inputPool);
+    if (!buffer)
+        return geode::Err("Could not allocate frame buffer.");
+
+    FrameHandle handle;
+    handle.m_buffer = buffer;
+    handle.m_data = std::span(alignFrameData(buffer->data), m_expectedSize);
+    return geode::Ok(handle);
+}
+
+geode::Result<> Recorder::Impl::submitFrame(FrameHandle& handle) {
+    if (!handle.isValid())
+        return geode::Err("Frame handle is not valid.");
+
+    AVBufferRef* buffer = static_cast<AVBufferRef*>(handle.m_buffer);
+    handle = {};
+
+    if (!m_init) {
+        av_buffer_unref(&buffer);
+        return geode::Err("Recorder is not initialized.");
+    }
+
+    // a skipped frame's buffer is either kept for the end of the recording or released
+    geode::Result<bool> duplicate = skipDuplicate(alignFrameData(buffer->data), buffer, std::nullopt);
+    if(duplicate.isErr()) {
+        av_buffer_unref(&buffer);
+        return geode::Err(duplicate.unwrapErr());
+    }
+    if(duplicate.unwrap())
+        return geode::Ok();
+
+    if(m_async) {
+        geode::Result<bool> space = waitForQueueSpace();
+        if(space.isErr() || !space.unwrap()) {
+            av_buffer_unref(&buffer);
+            if(space.isErr())
+                return geode::Err(space.unwrapErr());
+
+            m_frameCount++;
+            m_nextPts++;
+            m_framesDropped++;
+            return geode::Ok();
+        }
+    }
+
+    return submitBuffer(buffer, alignFrameData(buffer->data));
+}
+
+void Recorder::Impl::releaseFrame(FrameHandle& handle) {
+    AVBufferRef* buffer = static_cast<AVBufferRef*>(handle.m_buffer);
+    handle = {};
+
+    if (buffer)
+        av_buffer_unref(&buffer);
+}
+
+geode::Result<> Recorder::Impl::submitBuffer(AVBufferRef* buffer, uint8_t* data, std::optional<int64_t> timestampMicros) {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        av_buffer_unref(&buffer);
+        return geode::Err("Could not allocate frame.");
+    }
+
+    frame->format = m_frame->format;
+    frame->width = m_frame->width;
+    frame->height = m_frame->height;
+    frame->buf[0] = buffer;
+
+    int ret = av_image_fill_arrays(
+        frame->data,
+        frame->linesize,
+        data,
+        (AVPixelFormat)frame->format,
+        frame->width,
+        frame->height,
+        1
+    );
+
+    if (ret < 0) {
+        av_frame_free(&frame);
+        return geode::Err("Failed to fill image arrays: " + utils::getErrorString(ret));
+    }
+
+    if (geode::Result<> res = setTimestamp(frame, timestampMicros); res.isErr()) {
+        av_frame_free(&frame);
+        return res;
+    }
+
+    if(m_async) {
+        {
+            std::lock_guard lock(m_queueMutex);
+            m_frameQueue.push_back(frame);
+            m_queueDepth = m_frameQueue.size();
+        }
+        m_queueCondition.notify_one();
+        return geode::Ok();
+    }
+
+    geode::Result<> res = encodeFrame(frame);
+    av_frame_free(&frame);
+    return res;
+}
+
+geode::Result<bool> Recorder::Impl::waitForQueueSpace() {
+    std::unique_lock lock(m_queueMutex);
+    if(!m_asyncError.empty())
+        return geode::Err(m_asyncError);
+
+    if(m_frameQueue.size() < m_maxQueuedFrames)
+        return geode::Ok(true);
+
+    if(m_dropFramesWhenFull)
+        return geode::Ok(false);
+
+    m_spaceCondition.wait(lock, [this] {
+        return m_frameQueue.size() < m_maxQueuedFrames || !m_asyncError.empty();
+    });
+
+    if(!m_asyncError.empty())
+        return geode::Err(m_asyncError);
+
+    return geode::Ok(true);
+}
+
+void Recorder::Impl::encodeLoop() {
+    while (true) {
+        AVFrame* frame = nullptr;
+        {
+            std::unique_lock lock(m_queueMutex);
+            m_queueCondition.wait(lock, [this] { return !m_frameQueue.empty() || m_stopRequested; });
+
+            if(m_frameQueue.empty())
+                break;
+
+            frame = m_frameQueue.front();
+            m_frameQueue.pop_front();
+            m_queueDepth = m_frameQueue.size();
+        }
+        m_spaceCondition.notify_one();
+
+        bool failed;
+        {
+            std::lock_guard lock(m_queueMutex);
+            failed = !m_asyncError.empty();
+        }
+
+        // after an error the remaining frames are only drained
+        if(!failed) {
+            geode::Result<> res = encodeFrame(frame);
+            if(res.isErr()) {
+                {
+                    std::lock_guard lock(m_queueMutex);
+                    m_asyncError = res.unwrapErr();
+                }
+                m_spaceCondition.notify_all();
+            }
+        }
+
+        av_frame_free(&frame);
+    }
+}
+
+geode::Result<> Recorder::Impl::encodeFrame(AVFrame* frame) {
+    // frames are passed along by reference, nothing is copied unless a stage has to write new pixels
+    m_timings = {};
+
+    // the graph converts the frame itself, it only needs a (flipped) reference to it
+    if(m_buffersrcCtx) {
+        geode::Result<> res = referenceSource(frame, m_sourceView, !m_graphRetainsFrames);
+        if(res.isOk())
+            res = encodeConverted(m_sourceView);
+
+        av_frame_unref(m_sourceView);
+        return res;
+    }
+
+    if(!needsConversion())
+        return encodeConverted(frame);
+
+    auto start = Clock::now();
+    geode::Result<> res = convertFrame(frame, m_convertedFrame, m_swsCtx, m_sourceView);
+    m_timings.m_convert = Clock::now() - start;
+
+    if(res.isOk())
+        res = encodeConverted(m_convertedFrame);
+
+    av_frame_unref(m_convertedFrame);
+    return res;
+}
+
+bool Recorder::Impl::needsConversion() const {
+    return !m_buffersrcCtx && (m_swsCtx || m_fastConverter || m_doVerticalFlip);
+}
+
+geode::Result<> Recorder::Impl::referenceSource(AVFrame* frame, AVFrame* view, bool wrapBorrowed) {
+    av_frame_copy_props(view, frame);
+    view->format = frame->format;
+    view->width = frame->width;
+    view->height = frame->height;
+    for (int i = 0; i < 4; i++) {
+        view->data[i] = frame->data[i];
+        view->linesize[i] = frame->linesize[i];
+    }
+
+    // reading the source bottom-up flips the image as part of the conversion
+    if(m_doVerticalFlip)
+        flipPlanes(view->data, view->linesize, (AVPixelFormat)frame->format, frame->height);
+
+    if (frame->buf[0])
+        view->buf[0] = av_buffer_ref(frame->buf[0]);
+    else if (wrapBorrowed)
+        view->buf[0] = av_buffer_create(frame->data[0], m_expectedSize, [](void*, uint8_t*) {}, nullptr, AV_BUFFER_FLAG_READONLY);
+    else
+        return geode::Ok();
+
+    if (!view->buf[0])
+        return geode::Err("Could not reference source frame.");
+
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::convertFrame(AVFrame* frame, AVFrame* converted, SwsContext* swsCtx, AVFrame* sourceView) {
+    if (int ret = getPooledFrame(converted, m_convertedPool, m_codecContext->pix_fmt); ret < 0)
+        return geode::Err("Could not allocate converted frame: " + utils::getErrorString(ret));
+
+    uint8_t* srcData[4];
+    int srcLinesize[4];
+    for (int i = 0; i < 4; i++) {
+        srcData[i] = frame->data[i];
+        srcLinesize[i] = frame->linesize[i];
+    }
+
+    // reading the source bottom-up flips the image as part of the conversion
+    if(m_doVerticalFlip)
+        flipPlanes(srcData, srcLinesize, (AVPixelFormat)frame->format, frame->height);
+
+    if(m_fastConverter) {
+        m_fastConverter->convert(
+            srcData[0], srcLinesize[0], converted->data, converted->linesize,
+            frame->width, frame->height);
+    }
+    else if(swsCtx) {
+        // sws_scale_frame references its input, give it a refcounted view so borrowed buffers aren't copied
+        if (geode::Result<> res = referenceSource(frame, sourceView, true); res.isErr())
+            return res;
+
+        int ret = sws_scale_frame(swsCtx, converted, sourceView);
+        av_frame_unref(sourceView);
+
+        if (ret < 0)
+            return geode::Err("Could not convert frame: " + utils::getErrorString(ret));
+    }
+    else {
+        av_image_copy(
+            converted->data, converted->linesize, srcData, srcLinesize,
+            (AVPixelFormat)frame->format, frame->width, frame->height);
+    }
+
+    av_frame_copy_props(converted, frame);
+    converted->colorspace = m_codecContext->colorspace;
+    converted->color_primaries = m_codecContext->color_primaries;
+    converted->color_trc = m_codecContext->color_trc;
+    converted->color_range = m_codecContext->color_range;
+
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::encodeConverted(AVFrame* frame) {
+    geode::Result<> res = geode::Ok();
+
+    if(m_buffersrcCtx) {
+        auto start = Clock::now();
+        res = filterFrame(frame, m_filteredFrame);
+        m_timings.m_filter = Clock::now() - start;
+
+        if(res.isOk())
+            res = sendFiltered();
+    }
+    else {
+        res = sendFrame(frame);
+    }
+
+    if(res.isErr())
+        return res;
+
+    m_framesEncoded++;
+    if(needsConversion())
+        m_conversionLatency.push(m_timings.m_convert);
+    if(m_buffersrcCtx)
+        m_filterLatency.push(m_timings.m_filter);
+    m_encodeLatency.push(m_timings.m_send + m_timings.m_receive);
+    m_muxLatency.push(m_timings.m_mux);
+
+    if(m_timingCallback)
+        m_timingCallback(m_timings);
+
+    return res;
+}
+
+SwsContext* Recorder::Impl::createSwsContext(int threads) {
+    SwsContext* ctx = sws_alloc_context();
+    if (!ctx)
+        return nullptr;
+
+    AVPixelFormat srcFormat = (AVPixelFormat)m_frame->format;
+
+    // swscale splits the output into horizontal slices, one per thread, each computed
+    // by an identically configured context, so the result matches the single threaded path
+    av_opt_set_int(ctx, "srcw", m_codecContext->width, 0);
+    av_opt_set_int(ctx, "srch", m_codecContext->height, 0);
+    av_opt_set_int(ctx, "src_format", srcFormat, 0);
+    av_opt_set_int(ctx, "dstw", m_codecContext->width, 0);
+    av_opt_set_int(ctx, "dsth", m_codecContext->height, 0);
+    av_opt_set_int(ctx, "dst_format", m_codecContext->pix_fmt, 0);
+    av_opt_set_int(ctx, "sws_flags", SWS_FAST_BILINEAR, 0);
+    av_opt_set_int(ctx, "threads", threads, 0);
+
+    if (sws_init_context(ctx, nullptr, nullptr) < 0) {
+        sws_freeContext(ctx);
+        return nullptr;
+    }
+
+    if (usesBt709Matrix(m_settings, srcFormat, m_codecContext->pix_fmt)) {
+        const int* bt709 = sws_getCoefficients(SWS_CS_ITU709);
+        sws_setColorspaceDetails(ctx, bt709, 1, bt709, 0, 0, 1 << 16, 1 << 16);
+    }
+
+    return ctx;
+}
+
+geode::Result<> Recorder::Impl::writeFrames(std::span<std::span<uint8_t const> const> frames) {
+    if (!m_init || !m_frame)
+        return geode::Err("Recorder is not initialized.");
+
+    for (const auto& frameData : frames) {
+        if(frameData.size() != m_expectedSize)
+            return geode::Err("Frame data size does not match expected dimensions.");
+    }
+
+    // the worker thread converts queued frames, and unconverted frames go straight to the encoder
+    if(m_async || !needsConversion()) {
+        for (const auto& frameData : frames) {
+            geode::Result<> res = writeFrame(frameData);
+            if(res.isErr())
+                return res;
+        }
+        return geode::Ok();
+    }
+
+    size_t workers = std::max(std::thread::hardware_concurrency(), 1u);
+    if (!m_batchPool)
+        m_batchPool = new utils::WorkerPool(workers);
+
+    // swscale contexts aren't thread safe, every worker gets its own single threaded one
+    while (m_swsCtx && m_batchSwsCtxs.size() < workers) {
+        SwsContext* ctx = createSwsContext(1);
+        if (!ctx)
+            return geode::Err("Could not create sws context.");
+        m_batchSwsCtxs.push_back(ctx);
+        m_batchSourceViews.push_back(av_frame_alloc());
+    }
+
+    // the batch goes through in windows of one frame per worker, converted in parallel and encoded
+    // before the next window, so memory stays flat no matter how many frames are passed
+    size_t window = std::min(workers, frames.size());
+    std::vector<AVFrame*> sources(window);
+    std::vector<AVFrame*> converted(window);
+    std::vector<std::string> errors(window);
+    std::vector<Clock::duration> convertTimes(window);
+    std::vector<bool> skipped(window);
+
+    geode::Result<> res = geode::Ok();
+    for (size_t i = 0; i < window && res.isOk(); i++) {
+        sources[i] = av_frame_alloc();
+        converted[i] = av_frame_alloc();
+        if (!sources[i] || !converted[i])
+            res = geode::Err("Could not allocate frame.");
+    }
+
+    for (size_t first = 0; first < frames.size() && res.isOk(); first += window) {
+        size_t count = std::min(window, frames.size() - first);
+
+        // duplicates and timestamps are decided in order, frames after a failed one don't take a timestamp
+        geode::Result<> prepared = geode::Ok();
+        size_t ready = 0;
+        for (; ready < count; ready++) {
+            const uint8_t* data = frames[first + ready].data();
+            errors[ready].clear();
+            convertTimes[ready] = {};
+
+            AVBufferRef* borrowed = nullptr;
+            geode::Result<bool> duplicate = skipDuplicate(data, borrowed, std::nullopt);
+            if (duplicate.isErr()) {
+                prepared = geode::Err(duplicate.unwrapErr());
+                break;
+            }
+            skipped[ready] = duplicate.unwrap();
+            if (skipped[ready])
+                continue;
+
+            AVFrame* source = sources[ready];
+            source->format = m_frame->format;
+            source->width = m_frame->width;
+            source->height = m_frame->height;
+            av_image_fill_arrays(
+                source->data, source->linesize, data,
+                (AVPixelFormat)m_frame->format, m_frame->width, m_frame->height, 1);
+            if (prepared = setTimestamp(source, std::nullopt); prepared.isErr())
+                break;
+        }
+
+        m_batchPool->run(ready, [&](size_t i, size_t worker) {
+            if (skipped[i])
+                return;
+
+            SwsContext* swsCtx = m_swsCtx ? m_batchSwsCtxs[worker] : nullptr;
+            AVFrame* sourceView = m_swsCtx ? m_batchSourceViews[worker] : nullptr;
+
+            auto start = Clock::now();
+            geode::Result<> conversion = convertFrame(sources[i], converted[i], swsCtx, sourceView);
+            convertTimes[i] = Clock::now() - start;
+            if (conversion.isErr())
+                errors[i] = conversion.unwrapErr();
+        });
+
+        // encoding has to stay in order, so the window is fed to the encoder sequentially
+        for (size_t i = 0; i < ready && res.isOk(); i++) {
+            m_timings = {};
+            m_timings.m_convert = convertTimes[i];
+
+            if (!errors[i].empty())
+                res = geode::Err(errors[i]);
+            else if (!skipped[i])
+                res = encodeConverted(converted[i]);
+        }
+
+        for (size_t i = 0; i < ready; i++)
+            av_frame_unref(converted[i]);
+
+        if (res.isOk())
+            res = prepared;
+    }
+
+    for (size_t i = 0; i < window; i++) {
+        av_frame_free(&sources[i]);
+        av_frame_free(&converted[i]);
+    }
+
+    return res;
+}
+
+int Recorder::Impl::getPooledFrame(AVFrame* frame, AVBufferPool* pool, int format) {
+    av_frame_unref(frame);
+
+    frame->buf[0] = av_buffer_pool_get(pool);
+    if (!frame->buf[0])
+        return AVERROR(ENOMEM);
+
+    frame->format = format;
+    frame->width = m_codecContext->width;
+    frame->height = m_codecContext->height;
+
+    return av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, (AVPixelFormat)format, frame->width, frame->height, 32);
+}
+
+geode::Result<> Recorder::Impl::sendFrame(AVFrame* frame) {
+    // force a keyframe where the next segment should start, frames are reused so the type has to be reset otherwise
+    if (frame && m_segmentDuration > 0) {
+        bool forceKeyframe = m_nextKeyframePts == AV_NOPTS_VALUE || frame->pts >= m_nextKeyframePts;
+        frame->pict_type = forceKeyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        if (forceKeyframe)
+            m_nextKeyframePts = frame->pts + m_segmentDuration;
+    }
+
+    // frames are only collected here, the chunks are encoded on their own threads
+    if (m_chunkEncoder) {
+        auto start = Clock::now();
+        geode::Result<> res = frame ? m_chunkEncoder->send(frame) : m_chunkEncoder->finish();
+        m_timings.m_send += Clock::now() - start;
+        return res;
+    }
+
+    auto start = Clock::now();
+    int ret = avcodec_send_frame(m_codecContext, frame);
+    m_timings.m_send += Clock::now() - start;
+
+    if (ret < 0)
+        return geode::Err("Error while sending frame: " + utils::getErrorString(ret));
+
+    while (ret >= 0) {
+        start = Clock::now();
+        ret = avcodec_receive_packet(m_codecContext, m_packet);
+        auto received = Clock::now();
+        m_timings.m_receive += received - start;
+
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            return geode::Err("Error while receiving packet: " + utils::getErrorString(ret));
+
+        geode::Result<> res = writePacket(m_packet);
+        m_timings.m_mux += Clock::now() - received;
+
+        if (res.isErr())
+            return res;
+    }
+
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::writePacket(AVPacket* packet) {
+    recordPacket(packet);
+
+    if (m_replayBuffer) {
+        m_replayBuffer->push(packet);
+        av_packet_unref(packet);
+        return geode::Ok();
+    }
+
+    std::lock_guard lock(m_muxMutex);
+
+    if (!m_segmentError.empty()) {
+        av_packet_unref(packet);
+        return geode::Err(m_segmentError);
+    }
+
+    if (isSegmented()) {
+        if (m_segmentStart == AV_NOPTS_VALUE)
+            m_segmentStart = packet->pts;
+
+        bool full = (m_segmentDuration > 0 && packet->pts - m_segmentStart >= m_segmentDuration)
+            || (m_segmentSize > 0 && m_segmentBytes >= m_segmentSize);
+
+        if (full && (packet->flags & AV_PKT_FLAG_KEY)) {
+            if (geode::Result<> res = startSegment(packet->pts); res.isErr()) {
+                m_segmentError = res.unwrapErr();
+                av_packet_unref(packet);
+                return res;
+            }
+        }
+
+        m_segmentBytes += packet->size;
+
+        // every segment after the first starts at zero
+        packet->pts -= m_segmentOffset;
+        if (packet->dts != AV_NOPTS_VALUE)
+            packet->dts -= m_segmentOffset;
+    }
+
+    av_packet_rescale_ts(packet, m_codecContext->time_base, m_videoStream->time_base);
+    packet->stream_index = m_videoStream->index;
+
+    int ret = av_interleaved_write_frame(m_formatContext, packet);
+    av_packet_unref(packet);
+
+    if (ret < 0)
+        return geode::Err("Could not write packet: " + utils::getErrorString(ret));
+    return geode::Ok();
+}
+
+void Recorder::Impl::createChunkEncoder() {
+    size_t workers = m_settings.m_chunkEncoders;
+    if (workers == 0) {
+        // every worker is a session on the device, and m_codecContext holds one more
+        workers = (m_codec->capabilities & AV_CODEC_CAP_HARDWARE)
+            ? HARDWARE_CHUNK_ENCODERS
+            : std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // parallelism comes from the chunks, every encoder gets one core
+    m_chunkEncoder = new chunk::ChunkEncoder(workers, m_settings.m_chunkFrames,
+        [this] { return cloneEncoder(1); },
+        [this](AVPacket* packet) { return writePacket(packet); });
+}
+
+geode::Result<AVCodecContext*> Recorder::Impl::cloneEncoder(int threads) {
+    AVCodecContext* context = avcodec_alloc_context3(m_codec);
+    if (!context)
+        return geode::Err("Could not allocate video codec context.");
+
+    // same configuration as m_codecContext, without going through init again
+    context->hw_device_ctx = m_hwDevice ? av_buffer_ref(m_hwDevice) : nullptr;
+    context->bit_rate = m_codecContext->bit_rate;
+    context->width = m_codecContext->width;
+    context->height = m_codecContext->height;
+    context->time_base = m_codecContext->time_base;
+    context->framerate = m_codecContext->framerate;
+    context->pix_fmt = m_codecContext->pix_fmt;
+    context->sample_aspect_ratio = m_codecContext->sample_aspect_ratio;
+    context->colorspace = m_codecContext->colorspace;
+    context->color_primaries = m_codecContext->color_primaries;
+    context->color_trc = m_codecContext->color_trc;
+    context->color_range = m_codecContext->color_range;
+    context->flags = m_codecContext->flags;
+    context->max_b_frames = m_codecContext->max_b_frames;
+    context->thread_count = threads;
+    context->thread_type = m_codecContext->thread_type;
+
+    AVDictionary* options = nullptr;
+    for (const auto& [key, value] : m_codecOptions)
+        av_dict_set(&options, key.c_str(), value.c_str(), 0);
+
+    int ret = avcodec_open2(context, m_codec, &options);
+    av_dict_free(&options);
+
+    if (ret < 0) {
+        avcodec_free_context(&context);
+        return geode::Err("Could not open codec: " + utils::getErrorString(ret));
+    }
+
+    return geode::Ok(context);
+}
+
+geode::Result<> Recorder::Impl::initAudio(const RenderSettings& settings) {
+    m_audioCodec = avcodec_find_encoder_by_name(settings.m_audioCodec.c_str());
+    if (!m_audioCodec || m_audioCodec->type != AVMEDIA_TYPE_AUDIO)
+        return geode::Err("Could not find audio encoder.");
+
+    if (settings.m_audioSampleRate == 0)
+        return geode::Err("Audio sample rate must not be zero.");
+
+    m_audioCodecContext = avcodec_alloc_context3(m_audioCodec);
+    if (!m_audioCodecContext)
+        return geode::Err("Could not allocate audio codec context.");
+
+    // the requested rate if the encoder supports it, otherwise the closest one it does
+    int sampleRate = static_cast<int>(settings.m_audioSampleRate);
+    if (const int* rates = m_audioCodec->supported_samplerates) {
+        int closest = rates[0];
+        for (; *rates; ++rates) {
+            if (std::abs(*rates - sampleRate) < std::abs(closest - sampleRate))
+                closest = *rates;
+        }
+        sampleRate = closest;
+    }
+
+    m_audioCodecContext->sample_fmt = m_audioCodec->sample_fmts ? m_audioCodec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    m_audioCodecContext->sample_rate = sampleRate;
+    m_audioCodecContext->ch_layout = AV_CHANNEL_LAYOUT_STEREO;
+    m_audioCodecContext->bit_rate = settings.m_audioBitrate;
+    m_audioCodecContext->time_base = AVRational{1, sampleRate};
+
+    if (m_formatContext->oformat->flags & AVFMT_GLOBALHEADER)
+        m_audioCodecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    int ret = avcodec_open2(m_audioCodecContext, m_audioCodec, nullptr);
+    if (ret < 0)
+        return geode::Err("Could not open audio codec: " + utils::getErrorString(ret));
+
+    if (geode::Result<> res = addAudioStream(m_formatContext); res.isErr())
+        return res;
+
+    // converts the interleaved float input to the encoder's format and rate
+    AVChannelLayout stereo = AV_CHANNEL_LAYOUT_STEREO;
+    ret = swr_alloc_set_opts2(&m_audioResampler,
+        &stereo, m_audioCodecContext->sample_fmt, sampleRate,
+        &stereo, AV_SAMPLE_FMT_FLT, static_cast<int>(settings.m_audioSampleRate), 0, nullptr);
+    if (ret < 0 || (ret = swr_init(m_audioResampler)) < 0)
+        return geode::Err("Could not create audio resampler: " + utils::getErrorString(ret));
+
+    int frameSize = m_audioCodecContext->frame_size > 0 ? m_audioCodecContext->frame_size : 1024;
+    m_audioFifo = av_audio_fifo_alloc(m_audioCodecContext->sample_fmt, 2, frameSize * 4);
+    m_audioFrame = av_frame_alloc();
+    m_audioPacket = av_packet_alloc();
+    if (!m_audioFifo || !m_audioFrame || !m_audioPacket)
+        return geode::Err("Could not allocate audio buffers.");
+
+    m_audioInputRate = static_cast<int>(settings.m_audioSampleRate);
+    m_audioNextSample = AV_NOPTS_VALUE;
+    m_audioPts = 0;
+
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::addAudioStream(AVFormatContext* formatContext) {
+    AVStream* stream = avformat_new_stream(formatContext, m_audioCodec);
+    if (!stream)
+        return geode::Err("Could not create audio stream.");
+
+    if (int ret = avcodec_parameters_from_context(stream->codecpar, m_audioCodecContext); ret < 0)
+        return geode::Err("Could not copy audio codec parameters: " + utils::getErrorString(ret));
+
+    stream->time_base = m_audioCodecContext->time_base;
+    m_audioStream = stream;
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::writeAudio(std::span<float const> samples, int64_t timestampMicros) {
+    if (samples.size() % 2 != 0)
+        return geode::Err("Audio samples must be interleaved stereo.");
+
+    // stop() frees the encoder under the same lock
+    std::lock_guard lock(m_audioMutex);
+
+    if (!m_audioCodecContext)
+        return geode::Err("Audio is not enabled, set RenderSettings::m_audioCodec.");
+
+    // the encoder is drained for the old file, the new file's track starts with the first samples after restart
+    if (m_audioRestarting)
+        return geode::Ok();
+
+    const float* data = samples.data();
+    int64_t count = static_cast<int64_t>(samples.size() / 2);
+    int64_t position = av_rescale(timestampMicros, m_audioInputRate, 1000000);
+
+    // the first samples pin the track to the video timeline
+    if (m_audioNextSample == AV_NOPTS_VALUE) {
+        m_audioNextSample = position;
+        m_audioPts = av_rescale(position, m_audioCodecContext->sample_rate, m_audioInputRate);
+    }
+
+    int64_t drift = position - m_audioNextSample;
+    int64_t threshold = static_cast<int64_t>(m_audioInputRate) * AUDIO_RESYNC_MILLIS / 1000;
+
+    if (drift > threshold) {
+        // nothing was written for a while, keep later samples in sync by filling the gap.
+        // a long gap goes in one chunk at a time and is encoded as it goes, so memory stays flat
+        static const std::vector<float> silence(AUDIO_SILENCE_CHUNK * 2);
+        while (drift > 0) {
+            int chunk = static_cast<int>(std::min<int64_t>(drift, AUDIO_SILENCE_CHUNK));
+            if (geode::Result<> res = queueAudio(silence.data(), chunk); res.isErr())
+                return res;
+            if (geode::Result<> res = encodeAudio(false); res.isErr())
+                return res;
+            drift -= chunk;
+        }
+    }
+    else if (drift < -threshold) {
+        // these samples overlap what was already written
+        int64_t skip = std::min(-drift, count);
+        data += skip * 2;
+        count -= skip;
+        m_audioNextSample += skip;
+    }
+
+    if (count > 0) {
+        if (geode::Result<> res = queueAudio(data, static_cast<int>(count)); res.isErr())
+            return res;
+    }
+
+    return encodeAudio(false);
+}
+
+geode::Result<> Recorder::Impl::queueAudio(const float* samples, int count) {
+    int maxSamples = swr_get_out_samples(m_audioResampler, count);
+    if (maxSamples > m_audioBufferSamples) {
+        av_freep(&m_audioBuffer[0]);
+        if (int ret = av_samples_alloc(m_audioBuffer, nullptr, 2, maxSamples, m_audioCodecContext->sample_fmt, 0); ret < 0) {
+            m_audioBufferSamples = 0;
+            return geode::Err("Could not allocate audio buffer: " + utils::getErrorString(ret));
+        }
+        m_audioBufferSamples = maxSamples;
+    }
+
+    const uint8_t* input[1] = { reinterpret_cast<const uint8_t*>(samples) };
+    int converted = swr_convert(m_audioResampler, m_audioBuffer, m_audioBufferSamples, input, count);
+    if (converted < 0)
+        return geode::Err("Could not convert audio: " + utils::getErrorString(converted));
+
+    if (int ret = av_audio_fifo_write(m_audioFifo, reinterpret_cast<void**>(m_audioBuffer), converted); ret < 0)
+        return geode::Err("Could not queue audio: " + utils::getErrorString(ret));
+
+    m_audioNextSample += count;
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::encodeAudio(bool flush) {
+    int frameSize = m_audioCodecContext->frame_size > 0 ? m_audioCodecContext->frame_size : 1024;
+    bool fullFramesOnly = m_audioCodecContext->frame_size > 0
+        && !(m_audioCodec->capabilities & (AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_VARIABLE_FRAME_SIZE));
+
+    while (av_audio_fifo_size(m_audioFifo) >= frameSize || (flush && av_audio_fifo_size(m_audioFifo) > 0)) {
+        int samples = std::min(av_audio_fifo_size(m_audioFifo), frameSize);
+
+        av_frame_unref(m_audioFrame);
+        m_audioFrame->nb_samples = fullFramesOnly ? frameSize : samples;
+        m_audioFrame->format = m_audioCodecContext->sample_fmt;
+        m_audioFrame->sample_rate = m_audioCodecContext->sample_rate;
+        av_channel_layout_copy(&m_audioFrame->ch_layout, &m_audioCodecContext->ch_layout);
+
+        if (int ret = av_frame_get_buffer(m_audioFrame, 0); ret < 0)
+            return geode::Err("Could not allocate audio frame: " + utils::getErrorString(ret));
+
+        av_audio_fifo_read(m_audioFifo, reinterpret_cast<void**>(m_audioFrame->data), samples);
+        if (samples < m_audioFrame->nb_samples)
+            av_samples_set_silence(m_audioFrame->data, samples, m_audioFrame->nb_samples - samples, 2, m_audioCodecContext->sample_fmt);
+
+        m_audioFrame->pts = m_audioPts;
+        m_audioPts += samples;
+
+        if (geode::Result<> res = sendAudioFrame(m_audioFrame); res.isErr())
+            return res;
+    }
+
+    if (flush)
+        return sendAudioFrame(nullptr);
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::sendAudioFrame(AVFrame* frame) {
+    int ret = avcodec_send_frame(m_audioCodecContext, frame);
+    if (ret < 0)
+        return geode::Err("Error while sending audio frame: " + utils::getErrorString(ret));
+
+    while (true) {
+        ret = avcodec_receive_packet(m_audioCodecContext, m_audioPacket);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return geode::Ok();
+        if (ret < 0)
+            return geode::Err("Error while receiving audio packet: " + utils::getErrorString(ret));
+
+        m_bytesWritten += m_audioPacket->size;
+
+        std::lock_guard lock(m_muxMutex);
+
+        // a failed segment rollover leaves no output behind
+        if (!m_formatContext || !m_audioStream || !m_headerWritten) {
+            av_packet_unref(m_audioPacket);
+            continue;
+        }
+
+        if (m_segmentOffset != 0) {
+            int64_t offset = av_rescale_q(m_segmentOffset, m_codecContext->time_base, m_audioCodecContext->time_base);
+
+            // started before the rollover, it's kept at the start of the new segment rather than dropped
+            m_audioPacket->pts = std::max<int64_t>(m_audioPacket->pts - offset, 0);
+            if (m_audioPacket->dts != AV_NOPTS_VALUE)
+                m_audioPacket->dts = std::max<int64_t>(m_audioPacket->dts - offset, 0);
+        }
+
+        av_packet_rescale_ts(m_audioPacket, m_audioCodecContext->time_base, m_audioStream->time_base);
+        m_audioPacket->stream_index = m_audioStream->index;
+
+        ret = av_interleaved_write_frame(m_formatContext, m_audioPacket);
+        av_packet_unref(m_audioPacket);
+
+        if (ret < 0)
+            return geode::Err("Could not write audio packet: " + utils::getErrorString(ret));
+    }
+}
+
+geode::Result<> Recorder::Impl::resetAudio() {
+    std::lock_guard lock(m_audioMutex);
+
+    if (m_audioCodec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)
+        avcodec_flush_buffers(m_audioCodecContext);
+    else {
+        // audio encoders are cheap to open, so they're just opened again
+        AVCodecContext* context = avcodec_alloc_context3(m_audioCodec);
+        if (!context)
+            return geode::Err("Could not allocate audio codec context.");
+
+        context->sample_fmt = m_audioCodecContext->sample_fmt;
+        context->sample_rate = m_audioCodecContext->sample_rate;
+        av_channel_layout_copy(&context->ch_layout, &m_audioCodecContext->ch_layout);
+        context->bit_rate = m_audioCodecContext->bit_rate;
+        context->time_base = m_audioCodecContext->time_base;
+        context->flags = m_audioCodecContext->flags;
+
+        int ret = avcodec_open2(context, m_audioCodec, nullptr);
+        avcodec_free_context(&m_audioCodecContext);
+        m_audioCodecContext = context;
+
+        if (ret < 0)
+            return geode::Err("Could not open audio codec: " + utils::getErrorString(ret));
+    }
+
+    av_audio_fifo_reset(m_audioFifo);
+    swr_close(m_audioResampler);
+    if (int ret = swr_init(m_audioResampler); ret < 0)
+        return geode::Err("Could not create audio resampler: " + utils::getErrorString(ret));
+
+    m_audioNextSample = AV_NOPTS_VALUE;
+    m_audioPts = 0;
+    m_audioRestarting = false;
+    return geode::Ok();
+}
+
+void Recorder::Impl::freeAudio() {
+    if (m_audioCodecContext)
+        avcodec_free_context(&m_audioCodecContext);
+    if (m_audioResampler)
+        swr_free(&m_audioResampler);
+    if (m_audioFifo) {
+        av_audio_fifo_free(m_audioFifo);
+        m_audioFifo = nullptr;
+    }
+    if (m_audioFrame)
+        av_frame_free(&m_audioFrame);
+    if (m_audioPacket)
+        av_packet_free(&m_audioPacket);
+    av_freep(&m_audioBuffer[0]);
+    m_audioBufferSamples = 0;
+    m_audioStream = nullptr;
+    m_audioCodec = nullptr;
+    m_audioRestarting = false;
+}
+
+geode::Result<> Recorder::Impl::openOutput(const RenderSettings& settings) {
+    if (m_formatContext->oformat->flags & AVFMT_NOFILE)
+        return geode::Ok();
+
+    if (settings.m_outputCallbacks.m_write || settings.m_outputBuffer) {
+        m_callbackWriter = new io::CallbackWriter();
+        geode::Result<> res = m_callbackWriter->open(settings.m_outputCallbacks.m_write
+            ? settings.m_outputCallbacks
+            : io::getMemoryCallbacks(settings.m_outputBuffer));
+
+        if (res.isErr()) {
+            delete m_callbackWriter;
+            m_callbackWriter = nullptr;
+            return res;
+        }
+
+        m_formatContext->pb = m_callbackWriter->getContext();
+        m_formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+        return geode::Ok();
+    }
+
+    return openFile(m_segmentPath);
+}
+
+geode::Result<> Recorder::Impl::openFile(const std::filesystem::path& path) {
+    // muxer writes are collected into large blocks and written on their own thread
+    auto writer = new io::FileWriter(m_pendingWriteBytes, m_writeStalls);
+    geode::Result<> res = writer->open(path, [this](std::chrono::nanoseconds latency) {
+        m_diskLatency.push(latency);
+    });
+
+    if (res.isErr()) {
+        delete writer;
+        return res;
+    }
+
+    m_fileWriter = writer;
+
+    m_formatContext->pb = m_fileWriter->getContext();
+    m_formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::writeHeader() {
+    AVDictionary* formatOptions = nullptr;
+    if (m_fragmentedOutput) {
+        if (isFragmentableFormat(m_formatContext->oformat)) {
+            // a fragment per keyframe (at most ~2s) is written out with its own index, so nothing
+            // accumulates in memory, the file stays playable after a crash and the trailer is tiny
+            av_dict_set(&formatOptions, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+            av_dict_set(&formatOptions, "frag_duration", "2000000", 0);
+        }
+        else
+            geode::log::warn("Fragmented output is only supported for MP4 and MOV, {} is written normally", m_formatContext->oformat->name);
+    }
+
+    int ret = avformat_write_header(m_formatContext, &formatOptions);
+    av_dict_free(&formatOptions);
+
+    if (ret < 0)
+        return geode::Err("Could not write header: " + utils::getErrorString(ret));
+
+    m_headerWritten = true;
+    return geode::Ok();
+}
+
+bool Recorder::Impl::isSegmented() const {
+    return m_segmentDuration > 0 || m_segmentSize > 0;
+}
+
+geode::Result<> Recorder::Impl::startSegment(int64_t pts) {
+    // the encoder stays open, only the muxer and the file are replaced
+    const AVOutputFormat* format = m_formatContext->oformat;
+
+    int ret = av_write_trailer(m_formatContext);
+    m_headerWritten = false;
+    closeOutput();
+    avformat_free_context(m_formatContext);
+    m_formatContext = nullptr;
+    m_videoStream = nullptr;
+
+    if (ret < 0)
+        return geode::Err("Could not finish segment " + std::to_string(m_segmentIndex) + ": " + utils::getErrorString(ret));
+
+    if (m_segmentCallback)
+        m_segmentCallback(m_segmentPath);
+
+    m_segmentIndex++;
+    m_segmentPath = getSegmentPath(m_outputFile, m_segmentIndex);
+    m_segmentStart = pts;
+    m_segmentOffset = pts;
+    m_segmentBytes = 0;
+
+    return openContainer(format, m_segmentPath);
+}
+
+geode::Result<> Recorder::Impl::openContainer(const AVOutputFormat* format, const std::filesystem::path& path) {
+    int ret = avformat_alloc_output_context2(&m_formatContext, format, nullptr, path.string().c_str());
+    if (!m_formatContext)
+        return geode::Err("Could not create output context: " + utils::getErrorString(ret));
+
+    geode::Result<> res = openStreams(path);
+    if (res.isErr()) {
+        // nothing may be left half open, writePacket and stop only check for a null context
+        closeOutput();
+        avformat_free_context(m_formatContext);
+        m_formatContext = nullptr;
+        m_videoStream = nullptr;
+        m_audioStream = nullptr;
+    }
+    return res;
+}
+
+geode::Result<> Recorder::Impl::openStreams(const std::filesystem::path& path) {
+    int ret = 0;
+    AVStream* stream = avformat_new_stream(m_formatContext, m_codec);
+    if (!stream)
+        return geode::Err("Could not create video stream.");
+
+    if (ret = avcodec_parameters_from_context(stream->codecpar, m_codecContext); ret < 0)
+        return geode::Err("Could not copy codec parameters: " + utils::getErrorString(ret));
+    stream->time_base = m_codecContext->time_base;
+
+    if (m_audioCodecContext) {
+        if (geode::Result<> res = addAudioStream(m_formatContext); res.isErr())
+            return res;
+    }
+
+    if (!(m_formatContext->oformat->flags & AVFMT_NOFILE)) {
+        if (geode::Result<> res = openFile(path); res.isErr())
+            return res;
+    }
+
+    if (geode::Result<> res = writeHeader(); res.isErr())
+        return res;
+
+    m_videoStream = stream;
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::restart(const std::filesystem::path& path) {
+    if (!m_init)
+        return geode::Err("Recorder is not initialized.");
+    if (m_replayBuffer)
+        return geode::Err("Replay mode has no output to restart.");
+    if (m_settings.m_outputCallbacks.m_write || m_settings.m_outputBuffer)
+        return geode::Err("Only file output can be restarted.");
+    if (geode::Result<> res = getStatus(); res.isErr())
+        return res;
+
+    const AVOutputFormat* format = av_guess_format(
+        m_settings.m_outputFormat.empty() ? nullptr : m_settings.m_outputFormat.c_str(),
+        path.string().c_str(), nullptr);
+    if (!format)
+        return geode::Err("Could not find a container for " + path.string() + ".");
+
+    stopEncodeThread();
+
+    if (m_audioCodecContext) {
+        // from here on until resetAudio, writeAudio would feed an encoder that's drained for the old file
+        std::lock_guard lock(m_audioMutex);
+        m_audioRestarting = true;
+    }
+
+    finishOutput();
+
+    // nothing can be written until the new file is open
+    m_init = false;
+
+    // the encoder was drained by finishOutput, flushing only resets its end of stream state.
+    // otherwise, or if the new container needs global headers it wasn't opened with, it's opened again
+    bool needsGlobalHeader = (format->flags & AVFMT_GLOBALHEADER) && !(m_codecContext->flags & AV_CODEC_FLAG_GLOBAL_HEADER);
+    if ((m_codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH) && !needsGlobalHeader)
+        avcodec_flush_buffers(m_codecContext);
+    else {
+        if (needsGlobalHeader)
+            m_codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        geode::Result<AVCodecContext*> context = cloneEncoder(m_codecContext->thread_count);
+        if (context.isErr())
+            return geode::Err(context.unwrapErr());
+
+        avcodec_free_context(&m_codecContext);
+        m_codecContext = context.unwrap();
+    }
+
+    if (m_audioCodecContext) {
+        if (geode::Result<> res = resetAudio(); res.isErr())
+            return res;
+    }
+
+    if (m_chunkEncoder) {
+        delete m_chunkEncoder;
+        createChunkEncoder();
+    }
+
+    // a flushed filter graph can't take frames anymore
+    if (m_filterGraph) {
+        avfilter_graph_free(&m_filterGraph);
+        AVPixelFormat sourceFormat = (AVPixelFormat)m_settings.m_pixelFormat;
+        std::string filters = getFilterDescription(m_settings, sourceFormat, m_codecContext->pix_fmt);
+        if (geode::Result<> res = createFilterGraph(filters, sourceFormat, m_settings.m_filterThreads); res.isErr())
+            return res;
+    }
+
+    // the new file starts at zero, the stats keep counting
+    m_nextPts = 0;
+    m_lastPts = AV_NOPTS_VALUE;
+    m_lastFrameHash.reset();
+    m_skippedTailPts.reset();
+    if (m_duplicateBuffer)
+        av_buffer_unref(&m_duplicateBuffer);
+    m_bitrateWindow.clear();
+    m_bitrateWindowBytes = 0;
+    m_bitrate = 0.0;
+
+    m_settings.m_outputFile = path;
+    m_outputFile = path;
+    m_segmentIndex = 0;
+    m_segmentOffset = 0;
+    m_segmentBytes = 0;
+    m_segmentStart = AV_NOPTS_VALUE;
+    m_nextKeyframePts = AV_NOPTS_VALUE;
+    m_segmentError.clear();
+    m_segmentPath = isSegmented() ? getSegmentPath(path, 0) : path;
+
+    {
+        // audio packets are muxed as soon as the header is written
+        std::lock_guard lock(m_muxMutex);
+        if (geode::Result<> res = openContainer(format, m_segmentPath); res.isErr())
+            return res;
+    }
+
+    if (m_async) {
+        m_stopRequested = false;
+        m_encodeThread = std::thread(&Impl::encodeLoop, this);
+    }
+
+    m_init = true;
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::saveReplay(const std::filesystem::path& path) {
+    if (!m_replayBuffer)
+        return geode::Err("Replay mode is not enabled.");
+
+    replay::ReplayBuffer::Snapshot snapshot = m_replayBuffer->snapshot();
+    if (snapshot.m_packets.empty()) {
+        if (m_replayBuffer->getDroppedPackets() > 0)
+            return geode::Err("The replay buffer is empty, m_replayMaxBytes is too small to hold a keyframe.");
+        return geode::Err("The replay buffer is empty.");
+    }
+
+    AVFormatContext* formatContext = nullptr;
+    int ret = avformat_alloc_output_context2(&formatContext, nullptr, nullptr, path.string().c_str());
+    if (!formatContext)
+        return geode::Err("Could not create output context: " + utils::getErrorString(ret));
+
+    // a replay is written next to the recording, so it doesn't count towards the recorder's write stats
+    std::atomic<uint64_t> queuedBytes = 0;
+    std::atomic<uint64_t> stalls = 0;
+    io::FileWriter writer(queuedBytes, stalls);
+    AVPacket* packet = nullptr;
+
+    auto write = [&]() -> geode::Result<> {
+        AVStream* stream = avformat_new_stream(formatContext, m_codec);
+        if (!stream)
+            return geode::Err("Could not create video stream.");
+
+        if (ret = avcodec_parameters_from_context(stream->codecpar, m_codecContext); ret < 0)
+            return geode::Err("Could not copy codec parameters: " + utils::getErrorString(ret));
+        stream->time_base = m_codecContext->time_base;
+
+        if (!(formatContext->oformat->flags & AVFMT_NOFILE)) {
+            if (geode::Result<> res = writer.open(path, nullptr); res.isErr())
+                return res;
+            formatContext->pb = writer.getContext();
+            formatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+
+        if (ret = avformat_write_header(formatContext, nullptr); ret < 0)
+            return geode::Err("Could not write header: " + utils::getErrorString(ret));
+
+        packet = av_packet_alloc();
+        if (!packet)
+            return geode::Err("Could not allocate packet.");
+
+        // the clip starts at zero, the packets point straight into the snapshot
+        int64_t offset = snapshot.m_packets.front().m_pts;
+        for (const replay::ReplayBuffer::Packet& entry : snapshot.m_packets) {
+            packet->data = snapshot.m_data.data() + entry.m_offset;
+            packet->size = static_cast<int>(entry.m_size);
+            packet->pts = entry.m_pts - offset;
+            packet->dts = entry.m_dts != AV_NOPTS_VALUE ? entry.m_dts - offset : AV_NOPTS_VALUE;
+            packet->duration = entry.m_duration;
+            packet->flags = entry.m_keyframe ? AV_PKT_FLAG_KEY : 0;
+            packet->stream_index = stream->index;
+            av_packet_rescale_ts(packet, m_codecContext->time_base, stream->time_base);
+
+            if (ret = av_write_frame(formatContext, packet); ret < 0)
+                return geode::Err("Could not write packet: " + utils::getErrorString(ret));
+        }
+
+        if (ret = av_write_trailer(formatContext); ret < 0)
+            return geode::Err("Could not write trailer: " + utils::getErrorString(ret));
+
+        return writer.close();
+    };
+
+    geode::Result<> res = write();
+
+    av_packet_free(&packet);
+    (void) writer.close();
+    avformat_free_context(formatContext);
+
+    return res;
+}
+
+void Recorder::Impl::closeOutput() {
+    if (m_fileWriter) {
+        if (geode::Result<> res = m_fileWriter->close(); res.isErr())
+            geode::log::error("Failed to finish writing the output file: {}", res.unwrapErr());
+
+        delete m_fileWriter;
+        m_fileWriter = nullptr;
+    }
+
+    if (m_callbackWriter) {
+        if (geode::Result<> res = m_callbackWriter->close(); res.isErr())
+            geode::log::error("Failed to finish writing the output: {}", res.unwrapErr());
+
+        delete m_callbackWriter;
+        m_callbackWriter = nullptr;
+    }
+
+    m_formatContext->pb = nullptr;
+}
+
+void Recorder::Impl::recordPacket(AVPacket* packet) {
+    m_bytesWritten += packet->size;
+
+    int64_t timestamp = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (timestamp == AV_NOPTS_VALUE)
+        return;
+
+    // bitrate over the last second of video, not wall clock time, so it also works for offline renders
+    double timeBase = av_q2d(m_codecContext->time_base);
+    double time = timestamp * timeBase;
+    double frameDuration = (packet->duration > 0 ? packet->duration : m_frameDuration) * timeBase;
+
+    m_bitrateWindow.emplace_back(time, packet->size);
+    m_bitrateWindowBytes += packet->size;
+
+    while (m_bitrateWindow.front().first <= time - 1.0) {
+        m_bitrateWindowBytes -= m_bitrateWindow.front().second;
+        m_bitrateWindow.pop_front();
+    }
+
+    double duration = time - m_bitrateWindow.front().first + frameDuration;
+    m_bitrate = duration > 0 ? m_bitrateWindowBytes * 8 / duration : 0.0;
+}
+
+void Recorder::Impl::LatencyRing::push(std::chrono::nanoseconds duration) {
+    auto micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    size_t bucket = std::min<size_t>(std::bit_width(micros), LatencyHistogram::BUCKET_COUNT - 1);
+
+    uint64_t count = m_count.load(std::memory_order_relaxed);
+    m_buckets[count % SIZE].store(static_cast<uint8_t>(bucket), std::memory_order_relaxed);
+    m_count.store(count + 1, std::memory_order_release);
+}
+
+LatencyHistogram Recorder::Impl::LatencyRing::getHistogram() const {
+    LatencyHistogram histogram;
+
+    uint64_t count = m_count.load(std::memory_order_acquire);
+    histogram.m_samples = static_cast<uint32_t>(std::min<uint64_t>(count, SIZE));
+
+    for (uint32_t i = 0; i < histogram.m_samples; i++)
+        histogram.m_buckets[m_buckets[i].load(std::memory_order_relaxed)]++;
+
+    return histogram;
+}
+
+RecorderStats Recorder::Impl::getStats() const {
+    RecorderStats stats;
+    stats.m_framesSubmitted = m_frameCount;
+    stats.m_framesEncoded = m_framesEncoded;
+    stats.m_framesDropped = m_framesDropped;
+    stats.m_queueDepth = m_queueDepth;
+    stats.m_bytesWritten = m_bytesWritten;
+    stats.m_bitrate = m_bitrate;
+    stats.m_conversion = m_conversionLatency.getHistogram();
+    stats.m_filter = m_filterLatency.getHistogram();
+    stats.m_encode = m_encodeLatency.getHistogram();
+    stats.m_mux = m_muxLatency.getHistogram();
+    stats.m_framesSkipped = m_framesSkipped;
+    stats.m_diskWrite = m_diskLatency.getHistogram();
+    if (m_replayBuffer) {
+        stats.m_replayBytes = m_replayBuffer->getUsedBytes();
+        stats.m_replayDroppedPackets = m_replayBuffer->getDroppedPackets();
+    }
+    stats.m_encoderThreads = m_encoderThreads;
+    stats.m_encoderThreadType = m_encoderThreadType;
+    stats.m_pendingWriteBytes = m_pendingWriteBytes;
+    stats.m_writeStalls = m_writeStalls;
+    return stats;
+}
+
+geode::Result<> Recorder::Impl::getStatus() {
+    std::lock_guard lock(m_queueMutex);
+    if(!m_asyncError.empty())
+        return geode::Err(m_asyncError);
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::filterFrame(AVFrame* inputFrame, AVFrame* outputFrame) {
+    int ret = 0;
+    // refcounted frames are only referenced by the graph, borrowed ones get copied once by buffersrc.
+    // a null frame flushes the graph
+    if (ret = av_buffersrc_add_frame_flags(m_buffersrcCtx, inputFrame, AV_BUFFERSRC_FLAG_KEEP_REF); ret < 0)
+        return geode::Err("Could not feed frame to filter graph: " + utils::getErrorString(ret));
+
+    return getFilteredFrame(outputFrame);
+}
+
+geode::Result<> Recorder::Impl::getFilteredFrame(AVFrame* outputFrame) {
+    // filters like fps or tmix can hold frames back, an empty frame means there is nothing to encode yet
+    int ret = av_buffersink_get_frame(m_buffersinkCtx, outputFrame);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        return geode::Ok();
+
+    if (ret < 0) {
+        av_frame_unref(outputFrame);
+        return geode::Err("Could not retrieve frame from filter graph: " + utils::getErrorString(ret));
+    }
+
+    return geode::Ok();
+}
+
+geode::Result<> Recorder::Impl::sendFiltered() {
+    geode::Result<> res = geode::Ok();
+
+    // one input can produce several output frames
+    while (res.isOk() && m_filteredFrame->buf[0]) {
+        res = sendFrame(m_filteredFrame);
+        av_frame_unref(m_filteredFrame);
+
+        if (res.isOk())
+            res = getFilteredFrame(m_filteredFrame);
+    }
+
+    av_frame_unref(m_filteredFrame);
+    return res;
+}
+
+Recorder::Impl::~Impl() {
+    stop();
+}
+
+void Recorder::Impl::stopEncodeThread() {
+    if(!m_encodeThread.joinable())
+        return;
+
+    // the queue is drained before the thread exits
+    {
+        std::lock_guard lock(m_queueMutex);
+        m_stopRequested = true;
+    }
+    m_queueCondition.notify_one();
+    m_encodeThread.join();
+}
+
+void Recorder::Impl::finishOutput() {
+    if(m_codecContext && m_videoStream && m_formatContext && m_packet && m_headerWritten) {
+        // the last encoded frame has to cover skipped duplicates at the end too
+        if(m_duplicateBuffer && m_skippedTailPts && getStatus().isOk()) {
+            if(geode::Result<> res = encodeSkippedTail(); res.isErr())
+                geode::log::warn("Could not encode the last frame: {}", res.unwrapErr());
+        }
+
+        // frames still held back by the filter graph go first
+        if(m_buffersrcCtx && m_filteredFrame && filterFrame(nullptr, m_filteredFrame).isOk())
+            (void) sendFiltered();
+
+        (void) sendFrame(nullptr);
+
+        if(m_audioCodecContext) {
+            std::lock_guard lock(m_audioMutex);
+            if(geode::Result<> res = encodeAudio(true); res.isErr())
+                geode::log::warn("Could not finish the audio track: {}", res.unwrapErr());
+        }
+    }
+
+    bool finished = false;
+    {
+        // writeAudio can still be running on the caller's thread, keep it out until the output is gone
+        std::scoped_lock lock(m_audioMutex, m_muxMutex);
+
+        finished = m_formatContext && m_headerWritten && av_write_trailer(m_formatContext) >= 0;
+        m_headerWritten = false;
+
+        if(m_formatContext) {
+            closeOutput();
+            avformat_free_context(m_formatContext);
+            m_formatContext = nullptr;
+        }
+        m_videoStream = nullptr;
+        m_audioStream = nullptr;
+    }
+
+    if(finished && isSegmented() && m_segmentCallback)
+        m_segmentCallback(m_segmentPath);
+}
+
+void Recorder::Impl::stop() {
+    stopEncodeThread();
+    finishOutput();
+    m_segmentCallback = nullptr;
+
+    if(m_codecContext)
+        avcodec_free_context(&m_codecContext);
+    {
+        std::lock_guard lock(m_audioMutex);
+        freeAudio();
+    }
+
+    if(m_frame)
+        av_frame_free(&m_frame);
+    if(m_convertedFrame)
+        av_frame_free(&m_convertedFrame);
+
+    if(m_filterGraph)
+        avfilter_graph_free(&m_filterGraph);
+    m_buffersrcCtx = nullptr;
+    m_buffersinkCtx = nullptr;
+    if(m_filteredFrame)
+        av_frame_free(&m_filteredFrame);
+
+    if(m_swsCtx) {
+        sws_freeContext(m_swsCtx);
+        m_swsCtx = nullptr;
+    }
+    if(m_sourceView)
+        av_frame_free(&m_sourceView);
+    for (SwsContext* ctx : m_batchSwsCtxs)
+        sws_freeContext(ctx);
+    m_batchSwsCtxs.clear();
+    for (AVFrame*& view : m_batchSourceViews)
+        av_frame_free(&view);
+    m_batchSourceViews.clear();
+    delete m_batchPool;
+    m_batchPool = nullptr;
+
+    delete m_fastConverter;
+    m_fastConverter = nullptr;
+
+    delete m_replayBuffer;
+    m_replayBuffer = nullptr;
+
+    delete m_chunkEncoder;
+    m_chunkEncoder = nullptr;
+
+    delete m_frameHasher;
+    m_frameHasher = nullptr;
+    m_lastFrameHash.reset();
+    m_skippedTailPts.reset();
+    if(m_duplicateBuffer)
+        av_buffer_unref(&m_duplicateBuffer);
+
+    if (m_hwDevice)
+        av_buffer_unref(&m_hwDevice);
+
+    if(m_packet)
+        av_packet_free(&m_packet);
+
+    if(m_inputPool)
+        av_buffer_pool_uninit(&m_inputPool);
+    if(m_convertedPool)
+        av_buffer_pool_uninit(&m_convertedPool);
+
+    m_init = false;
 }
 
 END_FFMPEG_NAMESPACE_V
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "replay_buffer.hpp"
+
+#include <Geode/loader/Log.hpp>
+
+#include <cstring>
+
+extern "C" {
+    #include <libavcodec/packet.h>
+}
+
+namespace ffmpeg::replay {
+
+ReplayBuffer::ReplayBuffer(size_t capacity, int64_t duration)
+    : m_data(new uint8_t[capacity]), m_capacity(capacity), m_duration(duration) {}
+
+void ReplayBuffer::push(const AVPacket* packet) {
+    std::lock_guard lock(m_mutex);
+
+    bool keyframe = packet->flags & AV_PKT_FLAG_KEY;
+    size_t capacity = m_capacity;
+    size_t size = static_cast<size_t>(packet->size);
+
+    if (size > capacity) {
+        // can never fit, and everything stored before it is useless without it
+        if (m_droppedPackets == 0)
+            geode::log::warn("A {} byte packet doesn't fit into the {} byte replay buffer", size, capacity);
+        m_droppedPackets.fetch_add(1, std::memory_order_relaxed);
+        m_packets.clear();
+        updateUsedBytes();
+        return;
+    }
+
+    // packets are never split, if one doesn't fit before the end of the ring it starts over at the beginning
+    uint64_t start = m_writePosition;
+    if (start % capacity + size > capacity)
+        start += capacity - start % capacity;
+    uint64_t end = start + size;
+
+    // anything before end - capacity is about to be overwritten
+    while (!m_packets.empty() && end > capacity && m_packets.front().m_offset < end - capacity)
+        m_packets.pop_front();
+
+    // a GOP whose keyframe was evicted can't be decoded anymore
+    while (!m_packets.empty() && !m_packets.front().m_keyframe)
+        m_packets.pop_front();
+
+    if (m_packets.empty() && !keyframe) {
+        // the rest of a GOP that didn't fit
+        m_droppedPackets.fetch_add(1, std::memory_order_relaxed);
+        updateUsedBytes();
+        return;
+    }
+
+    std::memcpy(m_data.get() + start % capacity, packet->data, size);
+    m_writePosition = end;
+
+    m_packets.push_back({
+        .m_offset = start,
+        .m_size = static_cast<uint32_t>(size),
+        .m_pts = packet->pts,
+        .m_dts = packet->dts,
+        .m_duration = packet->duration,
+        .m_keyframe = keyframe
+    });
+
+    trim();
+    updateUsedBytes();
+}
+
+void ReplayBuffer::trim() {
+    // drop the oldest GOP as long as the rest still covers the whole duration
+    int64_t newest = m_packets.back().m_pts;
+    while (true) {
+        auto next = m_packets.begin() + 1;
+        while (next != m_packets.end() && !next->m_keyframe)
+            ++next;
+
+        if (next == m_packets.end() || newest - next->m_pts < m_duration)
+            break;
+
+        m_packets.erase(m_packets.begin(), next);
+    }
+}
+
+ReplayBuffer::Snapshot ReplayBuffer::snapshot() const {
+    std::lock_guard lock(m_mutex);
+
+    Snapshot snapshot;
+    snapshot.m_packets.reserve(m_packets.size());
+
+    size_t total = 0;
+    for (const Packet& packet : m_packets)
+        total += packet.m_size;
+    snapshot.m_data.resize(total);
+
+    size_t capacity = m_capacity;
+    uint64_t offset = 0;
+    for (Packet packet : m_packets) {
+        std::memcpy(snapshot.m_data.data() + offset, m_data.get() + packet.m_offset % capacity, packet.m_size);
+        packet.m_offset = offset;
+        offset += packet.m_size;
+        snapshot.m_packets.push_back(packet);
+    }
+
+    return snapshot;
+}
+
+void ReplayBuffer::updateUsedBytes() {
+    size_t used = m_packets.empty() ? 0 : static_cast<size_t>(m_writePosition - m_packets.front().m_offset);
+    m_usedBytes.store(used, std::memory_order_relaxed);
+}
+
+size_t ReplayBuffer::getUsedBytes() const {
+    return m_usedBytes.load(std::memory_order_relaxed);
+}
+
+uint64_t ReplayBuffer::getDroppedPackets() const {
+    return m_droppedPackets.load(std::memory_order_relaxed);
+}
+
+}
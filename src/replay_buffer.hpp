@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class AVPacket;
+
+namespace ffmpeg::replay {
+
+/**
+ * Keeps the most recent encoded packets in a single fixed-size byte ring, instead of
+ * an allocation per packet. Old packets are evicted a whole GOP at a time, so the
+ * stored window always starts at a keyframe and can be muxed without re-encoding.
+ */
+class ReplayBuffer {
+public:
+    struct Packet {
+        // position of the data, monotonic within the ring and relative to m_data in a snapshot
+        uint64_t m_offset = 0;
+        uint32_t m_size = 0;
+        int64_t m_pts = 0;
+        int64_t m_dts = 0;
+        int64_t m_duration = 0;
+        bool m_keyframe = false;
+    };
+
+    struct Snapshot {
+        std::vector<uint8_t> m_data;
+        std::vector<Packet> m_packets;
+    };
+
+    // duration is in the time base of the pushed packets
+    ReplayBuffer(size_t capacity, int64_t duration);
+
+    // called by the encoding thread
+    void push(const AVPacket* packet);
+    // copies the stored window out, so it can be muxed without blocking the encoder
+    Snapshot snapshot() const;
+    // doesn't lock, safe to poll from any thread
+    size_t getUsedBytes() const;
+    // packets that were thrown away because their GOP didn't fit, doesn't lock either
+    uint64_t getDroppedPackets() const;
+
+private:
+    void trim();
+    void updateUsedBytes();
+
+    // left uninitialized, pages are only committed once the ring reaches them
+    std::unique_ptr<uint8_t[]> m_data;
+    size_t m_capacity = 0;
+    std::atomic<size_t> m_usedBytes = 0;
+    std::atomic<uint64_t> m_droppedPackets = 0;
+    std::deque<Packet> m_packets;
+    uint64_t m_writePosition = 0;
+    int64_t m_duration = 0;
+    mutable std::mutex m_mutex;
+};
+
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define FFMPEG_API_X86
+    #include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+    #define FFMPEG_API_NEON
+    #include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define FFMPEG_API_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define FFMPEG_API_TARGET(isa)
+#endif
@@ -37,4 +37,62 @@ std::string getErrorString(int errorCode) {
 //     av_log_set_callback(customLogCallback);
 // }
 
+WorkerPool::WorkerPool(size_t threads) {
+    for (size_t worker = 1; worker < threads; worker++)
+        m_threads.emplace_back(&WorkerPool::workerLoop, this, worker);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t, size_t)>& fn) {
+    {
+        std::lock_guard lock(m_mutex);
+        m_task = &fn;
+        m_count = count;
+        m_next = 0;
+        m_busy = m_threads.size();
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    work(0);
+
+    std::unique_lock lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy == 0; });
+    m_task = nullptr;
+}
+
+void WorkerPool::work(size_t worker) {
+    for (size_t i = m_next++; i < m_count; i = m_next++)
+        (*m_task)(i, worker);
+}
+
+void WorkerPool::workerLoop(size_t worker) {
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+            if (m_stop)
+                return;
+            generation = m_generation;
+        }
+
+        work(worker);
+
+        std::lock_guard lock(m_mutex);
+        if (--m_busy == 0)
+            m_done.notify_one();
+    }
+}
+
 }
\ No newline at end of file
@@ -1,6 +1,12 @@
 #pragma once
 
 #include <string>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace ffmpeg::utils {
 
@@ -8,4 +14,35 @@ void customLogCallback(void* ptr, int level, const char* fmt, char* vargs);
 
 std::string getErrorString(int errorCode);
 
+// threads that stay alive between calls, so work split up again for every batch doesn't spawn new ones
+class WorkerPool {
+public:
+    // `threads` includes the calling thread, which always takes part as worker 0
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t getThreadCount() const { return m_threads.size() + 1; }
+
+    // calls fn(index, worker) for every index in [0, count) and returns once all of them are done
+    void run(size_t count, const std::function<void(size_t, size_t)>& fn);
+
+private:
+    void work(size_t worker);
+    void workerLoop(size_t worker);
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(size_t, size_t)>* m_task = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next = 0;
+    uint64_t m_generation = 0;
+    size_t m_busy = 0;
+    bool m_stop = false;
+};
+
 }
\ No newline at end of file